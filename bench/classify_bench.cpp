@@ -0,0 +1,88 @@
+// Batch point-in-hull classification against step10's hull_query.hpp, on
+// one core: a hull of V vertices (points on a circle) and N random query
+// points, about 60% of them inside. Compares one hull_locate() binary
+// search per point with hull_classify() over the whole batch, reports
+// points per second for each over R rounds, and checks that both agree.
+#include "hull_query.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchConfig {
+    int points = 1000000;
+    int vertices = 1000;
+    int rounds = 5;
+};
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:v:r:")) != -1) {
+        switch (opt) {
+        case 'n': cfg.points = std::atoi(optarg); break;
+        case 'v': cfg.vertices = std::atoi(optarg); break;
+        case 'r': cfg.rounds = std::atoi(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-n points] [-v hull_vertices] [-r rounds]" << std::endl;
+            return 1;
+        }
+    }
+    if (cfg.vertices < 3 || cfg.points < 1) {
+        std::cerr << "Need at least 3 vertices and 1 point" << std::endl;
+        return 1;
+    }
+
+    std::vector<Point> ring;
+    for (int i = 0; i < cfg.vertices; ++i) {
+        double angle = 6.283185307179586 * i / cfg.vertices;
+        ring.push_back({static_cast<float>(1000.0 * std::cos(angle)), static_cast<float>(1000.0 * std::sin(angle))});
+    }
+    std::vector<Point> hull = convex_hull(ring);
+    HullGeometry geo;
+    hull_geometry(hull, geo);
+
+    // The circle covers about 60% of the [-1130, 1130] square
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-1130.0f, 1130.0f);
+    std::vector<Point> points(cfg.points);
+    for (Point& p : points) p = {coord(rng), coord(rng)};
+
+    std::vector<uint8_t> scalar(points.size()), batch(points.size());
+    hull_classify(geo.fan, points.data(), points.size(), batch.data());
+    size_t disagree = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        scalar[i] = hull_locate(hull, points[i]) != HULL_OUTSIDE;
+        if (scalar[i] != batch[i]) ++disagree;
+    }
+    std::cout << "Hull of " << hull.size() << " vertices, " << points.size() << " points, "
+              << std::count(batch.begin(), batch.end(), 1) << " inside, "
+              << disagree << " on which the two disagree (boundary rounding)" << std::endl;
+
+    double best_scalar = 0, best_batch = 0;
+    for (int r = 0; r < cfg.rounds; ++r) {
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < points.size(); ++i) scalar[i] = hull_locate(hull, points[i]) != HULL_OUTSIDE;
+        std::chrono::duration<double> scalar_time = Clock::now() - start;
+        start = Clock::now();
+        hull_classify(geo.fan, points.data(), points.size(), batch.data());
+        std::chrono::duration<double> batch_time = Clock::now() - start;
+        double scalar_rate = points.size() / scalar_time.count();
+        double batch_rate = points.size() / batch_time.count();
+        best_scalar = std::max(best_scalar, scalar_rate);
+        best_batch = std::max(best_batch, batch_rate);
+        std::cout << "Round " << r + 1 << ": hull_locate " << static_cast<long>(scalar_rate)
+                  << " points/s | hull_classify " << static_cast<long>(batch_rate) << " points/s" << std::endl;
+    }
+    std::cout << "Best per core: hull_locate " << static_cast<long>(best_scalar) << " points/s | hull_classify "
+              << static_cast<long>(best_batch) << " points/s (" << best_batch / best_scalar << "x)" << std::endl;
+    if (scalar[0] + batch[0] == 3) std::cout << std::endl; // Keeps the results live
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Connect-storm benchmark: many threads open connections as fast as they can,
+// wait for the welcome line and hang up. Reports accept latency percentiles,
+// failures and connections per second.
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+static std::atomic<int> next_conn(0);
+static std::atomic<int> failures(0);
+
+static int open_connection(const addrinfo* ai) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) return -1;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void storm_worker(const addrinfo* ai, int total, std::vector<double>* latencies_ms) {
+    char buf[256];
+    while (next_conn.fetch_add(1) < total) {
+        Clock::time_point start = Clock::now();
+        int fd = open_connection(ai);
+        if (fd < 0) {
+            failures++;
+            continue;
+        }
+        // The connection only counts once the server has accepted it and greeted us
+        bool greeted = false;
+        ssize_t n;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            if (memchr(buf, '\n', n)) {
+                greeted = true;
+                break;
+            }
+        }
+        close(fd);
+        if (!greeted) {
+            failures++;
+            continue;
+        }
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+        latencies_ms->push_back(elapsed.count());
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[idx];
+}
+
+int main(int argc, char* argv[]) {
+    std::string host = "127.0.0.1";
+    std::string port = "9034";
+    int total = 10000;
+    int concurrency = 64;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:n:c:")) != -1) {
+        switch (opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = optarg; break;
+        case 'n': total = std::atoi(optarg); break;
+        case 'c': concurrency = std::atoi(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-h host] [-p port] [-n connections] [-c concurrency]" << std::endl;
+            return 1;
+        }
+    }
+
+    addrinfo hints{}, *ai;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rv = getaddrinfo(host.c_str(), port.c_str(), &hints, &ai);
+    if (rv != 0) {
+        std::cerr << "getaddrinfo: " << gai_strerror(rv) << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<double>> per_thread(concurrency);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < concurrency; ++i) {
+        threads.emplace_back(storm_worker, ai, total, &per_thread[i]);
+    }
+    for (auto& t : threads) t.join();
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    freeaddrinfo(ai);
+
+    std::vector<double> all;
+    for (auto& v : per_thread) all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+
+    std::cout << "Connections: " << all.size() << " ok, " << failures << " failed"
+              << " | " << (all.size() / elapsed.count()) << " conn/s" << std::endl;
+    std::cout << "Latency ms: p50 " << percentile(all, 0.50)
+              << " | p90 " << percentile(all, 0.90)
+              << " | p99 " << percentile(all, 0.99)
+              << " | max " << (all.empty() ? 0.0 : all.back()) << std::endl;
+    return failures > 0 ? 2 : 0;
+}
@@ -0,0 +1,189 @@
+// Coroutine handlers vs raw reactor callbacks, in one process: a reactor
+// thread serves C socketpair connections that each send D pipelined
+// "ping" lines and wait for D "pong" replies, over and over. Both servers
+// buffer partial lines and send one reply batch per read, so the
+// difference is the cost of the awaitable layer. Modes alternate for R
+// rounds; besides throughput, the reactor thread's CPU time per request is
+// reported, which the client threads competing for cores don't distort.
+#include "connection.hpp"
+#include "reactor.hpp"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchConfig {
+    int connections = 16;
+    int depth = 8;
+    double seconds = 2.0;
+    int rounds = 3;
+};
+
+struct RoundResult {
+    double requests_per_sec;
+    double server_ns_per_request;
+};
+
+static std::atomic<bool> stop(false);
+static void* reactor = nullptr;
+
+static double thread_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void reactor_thread(double* cpu_ns) {
+    double start = thread_cpu_ns();
+    runReactor(reactor);
+    *cpu_ns = thread_cpu_ns() - start;
+}
+
+static std::string reply_to(std::string_view line) {
+    return line == "ping" ? "pong\n" : "?\n";
+}
+
+// ---- Raw callbacks: per-fd input buffer, one send per readiness event
+
+static std::map<int, std::string> pending_input;
+
+static void on_callback_client(int fd) {
+    char buf[4096];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        if (n < 0 && errno == EAGAIN) return;
+        pending_input.erase(fd);
+        removeFdFromReactor(reactor, fd);
+        close(fd);
+        return;
+    }
+    std::string& input = pending_input[fd];
+    input.append(buf, n);
+    std::string out;
+    size_t start = 0, nl;
+    while ((nl = input.find('\n', start)) != std::string::npos) {
+        out += reply_to(std::string_view(input).substr(start, nl - start));
+        start = nl + 1;
+    }
+    input.erase(0, start);
+    if (!out.empty() && send(fd, out.data(), out.size(), MSG_NOSIGNAL) < 0) return;
+}
+
+// ---- Coroutines
+
+static Task serve(int fd) {
+    Connection conn(fd);
+    while (auto line = co_await conn.read_line()) {
+        if (!co_await conn.write(reply_to(*line))) break;
+    }
+}
+
+// ---- Clients
+
+static void client(int fd, int depth, long* requests) {
+    std::string batch;
+    for (int i = 0; i < depth; ++i) batch += "ping\n";
+    char buf[4096];
+    long n = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(batch.size())) break;
+        int replies = 0;
+        while (replies < depth) {
+            ssize_t got = recv(fd, buf, sizeof(buf), 0);
+            if (got <= 0) return;
+            replies += std::count(buf, buf + got, '\n');
+        }
+        n += depth;
+    }
+    *requests = n;
+}
+
+static RoundResult run(const BenchConfig& cfg, bool coroutines) {
+    reactor = startReactor();
+    set_connection_reactor(reactor);
+    std::vector<int> client_fds;
+    for (int i = 0; i < cfg.connections; ++i) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+        if (coroutines) serve(sv[1]);
+        else addFdToReactor(reactor, sv[1], on_callback_client);
+        client_fds.push_back(sv[0]);
+    }
+    double server_cpu_ns = 0;
+    std::thread loop(reactor_thread, &server_cpu_ns);
+
+    stop = false;
+    std::vector<long> requests(cfg.connections, 0);
+    std::vector<std::thread> clients;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < cfg.connections; ++i) {
+        clients.emplace_back(client, client_fds[i], cfg.depth, &requests[i]);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.seconds));
+    stop = true;
+    for (auto& t : clients) t.join();
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    for (int fd : client_fds) close(fd); // Handlers see EOF and finish
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stopReactor(reactor);
+    loop.join();
+
+    long total = 0;
+    for (long r : requests) total += r;
+    RoundResult result = {total / elapsed.count(), server_cpu_ns / std::max(1L, total)};
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:s:r:")) != -1) {
+        switch (opt) {
+        case 'c': cfg.connections = std::atoi(optarg); break;
+        case 'd': cfg.depth = std::atoi(optarg); break;
+        case 's': cfg.seconds = std::atof(optarg); break;
+        case 'r': cfg.rounds = std::atoi(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-c connections] [-d pipeline_depth] [-s seconds] [-r rounds]" << std::endl;
+            return 1;
+        }
+    }
+
+    RoundResult best_callback = {0, 1e18}, best_coroutine = {0, 1e18};
+    for (int r = 0; r < cfg.rounds; ++r) {
+        RoundResult callback = run(cfg, false);
+        RoundResult coroutine = run(cfg, true);
+        best_callback.requests_per_sec = std::max(best_callback.requests_per_sec, callback.requests_per_sec);
+        best_callback.server_ns_per_request = std::min(best_callback.server_ns_per_request, callback.server_ns_per_request);
+        best_coroutine.requests_per_sec = std::max(best_coroutine.requests_per_sec, coroutine.requests_per_sec);
+        best_coroutine.server_ns_per_request = std::min(best_coroutine.server_ns_per_request, coroutine.server_ns_per_request);
+        std::cout << "Round " << r + 1 << ": callbacks " << static_cast<long>(callback.requests_per_sec)
+                  << " req/s, " << static_cast<long>(callback.server_ns_per_request) << " server ns/req | coroutines "
+                  << static_cast<long>(coroutine.requests_per_sec) << " req/s, "
+                  << static_cast<long>(coroutine.server_ns_per_request) << " server ns/req" << std::endl;
+    }
+    std::cout << "Best: callbacks " << static_cast<long>(best_callback.requests_per_sec) << " req/s, "
+              << static_cast<long>(best_callback.server_ns_per_request) << " server ns/req | coroutines "
+              << static_cast<long>(best_coroutine.requests_per_sec) << " req/s, "
+              << static_cast<long>(best_coroutine.server_ns_per_request) << " server ns/req" << std::endl;
+    return 0;
+}
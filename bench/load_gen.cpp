@@ -0,0 +1,144 @@
+// Closed-loop load generator: each connection sends one command, waits for
+// its one-line reply and repeats. Reports throughput and latency percentiles.
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+struct LoadConfig {
+    std::string host = "127.0.0.1";
+    std::string port = "9034";
+    int connections = 64;
+    double seconds = 3.0;
+    int write_percent = 90; // Newpoint share; the rest are CH
+    int graphs = 1;         // > 1 spreads connections over graphs g0..gN-1
+};
+
+static std::atomic<bool> stop(false);
+static std::atomic<int> failures(0);
+
+static int connect_to(const LoadConfig& cfg) {
+    addrinfo hints{}, *ai, *p;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(cfg.host.c_str(), cfg.port.c_str(), &hints, &ai) != 0) return -1;
+    int fd = -1;
+    for (p = ai; p; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    return fd;
+}
+
+// Reads one reply line into line; buffered bytes past it stay in pending
+static bool read_line(int fd, std::string& pending, std::string& line) {
+    char buf[4096];
+    size_t pos;
+    while ((pos = pending.find('\n')) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        pending.append(buf, n);
+    }
+    line.assign(pending, 0, pos);
+    pending.erase(0, pos + 1);
+    return true;
+}
+
+static bool request(int fd, std::string& pending, const std::string& cmd) {
+    std::string line;
+    return send(fd, cmd.data(), cmd.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(cmd.size()) &&
+           read_line(fd, pending, line);
+}
+
+static void load_worker(const LoadConfig& cfg, int id, std::vector<double>* latencies_us) {
+    int fd = connect_to(cfg);
+    std::string pending, line;
+    if (fd < 0 || !read_line(fd, pending, line)) { // Welcome banner
+        failures++;
+        if (fd >= 0) close(fd);
+        return;
+    }
+    if (cfg.graphs > 1 && !request(fd, pending, "Use g" + std::to_string(id % cfg.graphs) + "\n")) {
+        failures++;
+        close(fd);
+        return;
+    }
+
+    std::mt19937 rng(id);
+    std::uniform_int_distribution<int> coord(-1000, 1000);
+    std::uniform_int_distribution<int> percent(0, 99);
+    while (!stop.load(std::memory_order_relaxed)) {
+        std::string cmd = percent(rng) < cfg.write_percent
+            ? "Newpoint " + std::to_string(coord(rng)) + "," + std::to_string(coord(rng)) + "\n"
+            : "CH\n";
+        Clock::time_point start = Clock::now();
+        if (!request(fd, pending, cmd)) {
+            failures++;
+            break;
+        }
+        std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+        latencies_us->push_back(elapsed.count());
+    }
+    close(fd);
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig cfg;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:s:w:g:")) != -1) {
+        switch (opt) {
+        case 'h': cfg.host = optarg; break;
+        case 'p': cfg.port = optarg; break;
+        case 'c': cfg.connections = std::atoi(optarg); break;
+        case 's': cfg.seconds = std::atof(optarg); break;
+        case 'w': cfg.write_percent = std::atoi(optarg); break;
+        case 'g': cfg.graphs = std::atoi(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-h host] [-p port] [-c connections] [-s seconds]"
+                      << " [-w write_percent] [-g graphs]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::vector<double>> per_conn(cfg.connections);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < cfg.connections; ++i) {
+        threads.emplace_back(load_worker, std::cref(cfg), i, &per_conn[i]);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.seconds));
+    stop = true;
+    for (auto& t : threads) t.join();
+
+    std::vector<double> all;
+    for (auto& v : per_conn) all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+
+    std::cout << "Requests: " << all.size() << " | " << static_cast<long>(all.size() / cfg.seconds)
+              << " req/s | failures: " << failures << std::endl;
+    std::cout << "Latency us: p50 " << percentile(all, 0.50)
+              << " | p99 " << percentile(all, 0.99)
+              << " | p99.9 " << percentile(all, 0.999)
+              << " | max " << (all.empty() ? 0.0 : all.back()) << std::endl;
+    return failures > 0 ? 2 : 0;
+}
@@ -0,0 +1,198 @@
+// Bulk uploaders next to interactive clients. Each bulk connection streams
+// bursts of pipelined Newpoint lines, keeping up to W lines unanswered,
+// while each interactive connection sends one Newpoint and waits for its
+// reply. Reports the interactive latency percentiles and bulk throughput,
+// i.e. how well the server's loop shares itself between the two.
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+struct MixConfig {
+    std::string host = "127.0.0.1";
+    std::string port = "9034";
+    int bulk = 4;          // Bulk connections
+    int interactive = 4;   // Interactive connections
+    int burst = 1000;      // Lines per bulk send
+    int window = 8000;     // Unanswered lines a bulk connection allows
+    double seconds = 5.0;
+};
+
+static std::atomic<bool> stop(false);
+static std::atomic<int> failures(0);
+static std::atomic<long> bulk_lines(0);
+
+static int connect_to(const MixConfig& cfg) {
+    addrinfo hints{}, *ai, *p;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(cfg.host.c_str(), cfg.port.c_str(), &hints, &ai) != 0) return -1;
+    int fd = -1;
+    for (p = ai; p; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    return fd;
+}
+
+// Reads one reply line into line; buffered bytes past it stay in pending
+static bool read_line(int fd, std::string& pending, std::string& line) {
+    char buf[4096];
+    size_t pos;
+    while ((pos = pending.find('\n')) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        pending.append(buf, n);
+    }
+    line.assign(pending, 0, pos);
+    pending.erase(0, pos + 1);
+    return true;
+}
+
+static bool send_all(int fd, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+static std::string newpoint(std::mt19937& rng) {
+    std::uniform_int_distribution<int> coord(-1000, 1000);
+    return "Newpoint " + std::to_string(coord(rng)) + "," + std::to_string(coord(rng)) + "\n";
+}
+
+// Counts reply lines so the sender knows how far ahead it is
+static void bulk_reader(int fd, std::atomic<long>* answered) {
+    char buf[65536];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        long lines = std::count(buf, buf + n, '\n');
+        answered->fetch_add(lines, std::memory_order_relaxed);
+        bulk_lines.fetch_add(lines, std::memory_order_relaxed);
+    }
+}
+
+static void bulk_worker(const MixConfig& cfg, int id) {
+    int fd = connect_to(cfg);
+    std::string pending, line;
+    if (fd < 0 || !read_line(fd, pending, line)) { // Welcome banner
+        failures++;
+        if (fd >= 0) close(fd);
+        return;
+    }
+    std::atomic<long> answered(0);
+    std::thread reader(bulk_reader, fd, &answered);
+
+    std::mt19937 rng(1000 + id);
+    std::string burst;
+    long sent = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (sent - answered.load(std::memory_order_relaxed) > cfg.window - cfg.burst) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        burst.clear();
+        for (int i = 0; i < cfg.burst; ++i) burst += newpoint(rng);
+        if (!send_all(fd, burst)) {
+            failures++;
+            break;
+        }
+        sent += cfg.burst;
+    }
+    shutdown(fd, SHUT_RDWR);
+    reader.join();
+    close(fd);
+}
+
+static void interactive_worker(const MixConfig& cfg, int id, std::vector<double>* latencies_us) {
+    int fd = connect_to(cfg);
+    std::string pending, line;
+    if (fd < 0 || !read_line(fd, pending, line)) {
+        failures++;
+        if (fd >= 0) close(fd);
+        return;
+    }
+    std::mt19937 rng(id);
+    while (!stop.load(std::memory_order_relaxed)) {
+        std::string cmd = newpoint(rng);
+        Clock::time_point start = Clock::now();
+        if (!send_all(fd, cmd) || !read_line(fd, pending, line)) {
+            failures++;
+            break;
+        }
+        std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+        latencies_us->push_back(elapsed.count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1)); // A person, or a light producer
+    }
+    close(fd);
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+}
+
+int main(int argc, char* argv[]) {
+    MixConfig cfg;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:b:i:l:w:s:")) != -1) {
+        switch (opt) {
+        case 'h': cfg.host = optarg; break;
+        case 'p': cfg.port = optarg; break;
+        case 'b': cfg.bulk = std::atoi(optarg); break;
+        case 'i': cfg.interactive = std::atoi(optarg); break;
+        case 'l': cfg.burst = std::atoi(optarg); break;
+        case 'w': cfg.window = std::atoi(optarg); break;
+        case 's': cfg.seconds = std::atof(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-h host] [-p port] [-b bulk_connections]"
+                      << " [-i interactive_connections] [-l burst_lines] [-w window_lines] [-s seconds]" << std::endl;
+            return 1;
+        }
+    }
+    if (cfg.burst < 1 || cfg.window < cfg.burst) {
+        std::cerr << "Need 1 <= burst_lines <= window_lines" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<double>> per_conn(cfg.interactive);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < cfg.bulk; ++i) threads.emplace_back(bulk_worker, std::cref(cfg), i);
+    for (int i = 0; i < cfg.interactive; ++i) {
+        threads.emplace_back(interactive_worker, std::cref(cfg), i, &per_conn[i]);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.seconds));
+    stop = true;
+    for (auto& t : threads) t.join();
+
+    std::vector<double> all;
+    for (auto& v : per_conn) all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+
+    std::cout << "Bulk: " << static_cast<long>(bulk_lines / cfg.seconds) << " lines/s over " << cfg.bulk
+              << " connections | failures: " << failures << std::endl;
+    std::cout << "Interactive: " << all.size() << " requests | latency us: p50 " << percentile(all, 0.50)
+              << " | p99 " << percentile(all, 0.99)
+              << " | p99.9 " << percentile(all, 0.999)
+              << " | max " << (all.empty() ? 0.0 : all.back()) << std::endl;
+    return failures > 0 ? 2 : 0;
+}
@@ -0,0 +1,150 @@
+// Request parsing, stream-based vs. step10's parse.hpp: both parse the same
+// mix of command and point lines (mostly Newpoint and bare "x,y" lines, as
+// in point ingest) into a command and its numbers. Reports lines per second
+// for each over R rounds, and checks that both parsers agree.
+#include "parse.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchConfig {
+    int lines = 1000000;
+    int rounds = 5;
+};
+
+struct Parsed {
+    int id = CMD_UNKNOWN;
+    bool ok = false;
+    Point p = {0, 0};
+    int n = 0;
+};
+
+// What every server did before: istringstream tokens, string compares,
+// ',' -> ' ' and operator>> into floats
+static Parsed parse_with_streams(const std::string& line, bool point_line) {
+    Parsed r;
+    if (point_line) {
+        std::string coords = line;
+        std::replace(coords.begin(), coords.end(), ',', ' ');
+        std::istringstream iss(coords);
+        r.ok = static_cast<bool>(iss >> r.p.x >> r.p.y);
+        return r;
+    }
+    std::istringstream iss(line);
+    std::string cmd;
+    iss >> cmd;
+    if (cmd == "Newgraph") {
+        r.id = CMD_NEWGRAPH;
+        r.ok = (iss >> r.n) && r.n >= 1;
+    } else if (cmd == "Newpoint" || cmd == "Removepoint") {
+        r.id = cmd == "Newpoint" ? CMD_NEWPOINT : CMD_REMOVEPOINT;
+        std::string coords;
+        if (iss >> coords) {
+            std::replace(coords.begin(), coords.end(), ',', ' ');
+            std::istringstream coord_iss(coords);
+            r.ok = static_cast<bool>(coord_iss >> r.p.x >> r.p.y);
+        }
+    } else if (cmd == "CH") {
+        r.id = CMD_CH;
+        r.ok = true;
+    }
+    return r;
+}
+
+static Parsed parse_with_views(std::string_view line, bool point_line) {
+    Parsed r;
+    if (point_line) {
+        r.ok = parse_point(line, r.p);
+        return r;
+    }
+    CommandLine cmd;
+    parse_command(line, cmd);
+    r.id = cmd.id;
+    switch (cmd.id) {
+    case CMD_NEWGRAPH: r.ok = cmd.argc >= 1 && parse_count(cmd.args[0], r.n); break;
+    case CMD_NEWPOINT:
+    case CMD_REMOVEPOINT: r.ok = cmd.argc >= 1 && parse_point(cmd.args[0], r.p); break;
+    case CMD_CH: r.ok = true; break;
+    default: break;
+    }
+    return r;
+}
+
+struct Line {
+    std::string text;
+    bool point_line;
+};
+
+static std::vector<Line> make_lines(int count) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-1000.0f, 1000.0f);
+    std::vector<Line> lines;
+    lines.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        std::ostringstream text;
+        int kind = i % 10;
+        bool point_line = kind < 4;
+        if (point_line) text << coord(rng) << "," << coord(rng);
+        else if (kind < 8) text << "Newpoint " << coord(rng) << "," << coord(rng);
+        else if (kind == 8) text << "Removepoint " << coord(rng) << "," << coord(rng);
+        else text << (i % 20 == 9 ? "CH" : "Newgraph 100");
+        lines.push_back({text.str(), point_line});
+    }
+    return lines;
+}
+
+static double checksum(const Parsed& r) {
+    return r.id + r.ok + r.p.x + r.p.y + r.n;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n': cfg.lines = std::atoi(optarg); break;
+        case 'r': cfg.rounds = std::atoi(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-n lines] [-r rounds]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Line> lines = make_lines(cfg.lines);
+    for (const Line& line : lines) {
+        Parsed a = parse_with_streams(line.text, line.point_line);
+        Parsed b = parse_with_views(line.text, line.point_line);
+        if (a.id != b.id || a.ok != b.ok || a.p.x != b.p.x || a.p.y != b.p.y || a.n != b.n) {
+            std::cerr << "Parsers disagree on \"" << line.text << "\"" << std::endl;
+            return 1;
+        }
+    }
+
+    double best_streams = 0, best_views = 0, sink = 0;
+    for (int r = 0; r < cfg.rounds; ++r) {
+        Clock::time_point start = Clock::now();
+        for (const Line& line : lines) sink += checksum(parse_with_streams(line.text, line.point_line));
+        std::chrono::duration<double> streams = Clock::now() - start;
+        start = Clock::now();
+        for (const Line& line : lines) sink += checksum(parse_with_views(line.text, line.point_line));
+        std::chrono::duration<double> views = Clock::now() - start;
+        double streams_rate = lines.size() / streams.count();
+        double views_rate = lines.size() / views.count();
+        best_streams = std::max(best_streams, streams_rate);
+        best_views = std::max(best_views, views_rate);
+        std::cout << "Round " << r + 1 << ": streams " << static_cast<long>(streams_rate)
+                  << " lines/s | string_view+from_chars " << static_cast<long>(views_rate) << " lines/s" << std::endl;
+    }
+    std::cout << "Best: streams " << static_cast<long>(best_streams) << " lines/s | string_view+from_chars "
+              << static_cast<long>(best_views) << " lines/s (" << best_views / best_streams << "x)" << std::endl;
+    if (sink == 0.123) std::cout << std::endl; // Keeps the results live
+    return 0;
+}
@@ -0,0 +1,93 @@
+// Read-heavy CH benchmark against step10's graph store: R reader threads
+// query the hull area while one writer keeps mutating the same graph.
+// With -l every read also takes the graph mutex, which is how CH behaved
+// before snapshots were published.
+#include "graph_store.hpp"
+#include <unistd.h>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+static std::atomic<bool> stop(false);
+static bool locked_reads = false;
+
+static void reader(Graph* graph, long* reads) {
+    long n = 0;
+    float area;
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (locked_reads) {
+            std::lock_guard<std::mutex> lock(graph->mutex);
+            area = graph->snapshot.load()->hull_area;
+        } else {
+            graph_hull_area(*graph, area);
+        }
+        ++n;
+    }
+    *reads = n;
+}
+
+static void writer(Graph* graph, long* writes) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> inner(-900.0f, 900.0f);
+    long n = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        Point p = {inner(rng), inner(rng)};
+        graph_add_point(*graph, p);
+        graph_remove_point(*graph, p);
+        n += 2;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    *writes = n;
+}
+
+int main(int argc, char* argv[]) {
+    int points = 100000;
+    int max_readers = 8;
+    double seconds = 1.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:s:l")) != -1) {
+        switch (opt) {
+        case 'n': points = std::atoi(optarg); break;
+        case 'r': max_readers = std::atoi(optarg); break;
+        case 's': seconds = std::atof(optarg); break;
+        case 'l': locked_reads = true; break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-n points] [-r max_readers] [-s seconds] [-l]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::shared_ptr<Graph> graph = get_graph("bench");
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-1000.0f, 1000.0f);
+    for (int i = 0; i < points; ++i) graph_add_point(*graph, {coord(rng), coord(rng)});
+
+    std::cout << (locked_reads ? "Locked" : "Snapshot") << " reads, " << points << " points" << std::endl;
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+        stop = false;
+        std::vector<long> reads(readers, 0);
+        long writes = 0;
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < readers; ++i) threads.emplace_back(reader, graph.get(), &reads[i]);
+        std::thread w(writer, graph.get(), &writes);
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        for (auto& t : threads) t.join();
+        w.join();
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        long total = 0;
+        for (long r : reads) total += r;
+        std::cout << "Readers: " << readers
+                  << " | CH reads/s: " << static_cast<long>(total / elapsed.count())
+                  << " | writes/s: " << static_cast<long>(writes / elapsed.count()) << std::endl;
+    }
+    return 0;
+}
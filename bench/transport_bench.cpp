@@ -0,0 +1,198 @@
+// Local TCP against a Unix domain socket on the same server. Start the
+// server with both listeners (e.g. -p 9034 -u @convex_hull). Each connection
+// sends D pipelined Newpoint lines, waits for their D replies and repeats;
+// D = 1 is a plain round trip. The transports alternate for R rounds, and
+// the report gives requests per second and per-batch latency for each.
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+struct TransportConfig {
+    std::string host = "127.0.0.1";
+    std::string port = "9034";
+    std::string unix_path = "@convex_hull";
+    int connections = 4;
+    int depth = 64;       // Lines per pipelined batch
+    double seconds = 2.0; // Per transport, depth and round
+    int rounds = 3;
+};
+
+static std::atomic<int> failures(0);
+
+static int connect_tcp(const TransportConfig& cfg) {
+    addrinfo hints{}, *ai, *p;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(cfg.host.c_str(), cfg.port.c_str(), &hints, &ai) != 0) return -1;
+    int fd = -1;
+    for (p = ai; p; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    return fd;
+}
+
+// '@' first names a socket in the abstract namespace
+static int connect_unix(const TransportConfig& cfg) {
+    const std::string& path = cfg.unix_path;
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return -1;
+    bool abstract = path[0] == '@';
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (abstract) addr.sun_path[0] = '\0';
+    socklen_t len = offsetof(sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr*)&addr, len) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+// Reads until `lines` reply lines have arrived; the protocol never sends
+// more than were asked for, so no bytes past the last one are lost
+static bool read_lines(int fd, int lines) {
+    char buf[65536];
+    while (lines > 0) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        lines -= std::count(buf, buf + n, '\n');
+    }
+    return true;
+}
+
+static void worker(const TransportConfig& cfg, bool unix_socket, int depth, int id, Clock::time_point deadline,
+                   std::vector<double>* latencies_us, long* requests) {
+    int fd = unix_socket ? connect_unix(cfg) : connect_tcp(cfg);
+    if (fd < 0 || !read_lines(fd, 1)) { // Welcome banner
+        failures++;
+        if (fd >= 0) close(fd);
+        return;
+    }
+    std::mt19937 rng(id);
+    std::uniform_int_distribution<int> coord(-1000, 1000);
+    std::string batch;
+    for (int i = 0; i < depth; ++i) {
+        batch += "Newpoint " + std::to_string(coord(rng)) + "," + std::to_string(coord(rng)) + "\n";
+    }
+    while (Clock::now() < deadline) {
+        Clock::time_point start = Clock::now();
+        if (!send_all(fd, batch) || !read_lines(fd, depth)) {
+            failures++;
+            break;
+        }
+        std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+        latencies_us->push_back(elapsed.count());
+        *requests += depth;
+    }
+    close(fd);
+}
+
+struct PhaseResult {
+    long requests = 0;
+    double seconds = 0;
+    std::vector<double> latencies_us;
+};
+
+static void run_phase(const TransportConfig& cfg, bool unix_socket, int depth, PhaseResult& result) {
+    std::vector<std::vector<double>> per_conn(cfg.connections);
+    std::vector<long> requests(cfg.connections, 0);
+    std::vector<std::thread> threads;
+    Clock::time_point deadline =
+        Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(cfg.seconds));
+    for (int i = 0; i < cfg.connections; ++i) {
+        threads.emplace_back(worker, std::cref(cfg), unix_socket, depth, i, deadline, &per_conn[i], &requests[i]);
+    }
+    for (auto& t : threads) t.join();
+    for (int i = 0; i < cfg.connections; ++i) {
+        result.requests += requests[i];
+        result.latencies_us.insert(result.latencies_us.end(), per_conn[i].begin(), per_conn[i].end());
+    }
+    result.seconds += cfg.seconds;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+}
+
+int main(int argc, char* argv[]) {
+    TransportConfig cfg;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:u:c:d:s:r:")) != -1) {
+        switch (opt) {
+        case 'h': cfg.host = optarg; break;
+        case 'p': cfg.port = optarg; break;
+        case 'u': cfg.unix_path = optarg; break;
+        case 'c': cfg.connections = std::atoi(optarg); break;
+        case 'd': cfg.depth = std::atoi(optarg); break;
+        case 's': cfg.seconds = std::atof(optarg); break;
+        case 'r': cfg.rounds = std::atoi(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-h host] [-p port] [-u unix_path|@name] [-c connections]"
+                      << " [-d pipeline_depth] [-s seconds] [-r rounds]" << std::endl;
+            return 1;
+        }
+    }
+    if (cfg.connections < 1 || cfg.depth < 1 || cfg.rounds < 1) {
+        std::cerr << "Need at least one connection, line and round" << std::endl;
+        return 1;
+    }
+
+    std::vector<int> depths = {1};
+    if (cfg.depth > 1) depths.push_back(cfg.depth);
+    // results[d][t]: depth index, then TCP (0) or Unix socket (1)
+    std::vector<std::vector<PhaseResult>> results(depths.size(), std::vector<PhaseResult>(2));
+    for (int round = 0; round < cfg.rounds; ++round) {
+        for (size_t d = 0; d < depths.size(); ++d) {
+            for (int t = 0; t < 2; ++t) run_phase(cfg, t == 1, depths[d], results[d][t]);
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << cfg.connections << " connections, " << cfg.rounds << " rounds of " << cfg.seconds << " s"
+              << " | failures: " << failures << std::endl;
+    for (size_t d = 0; d < depths.size(); ++d) {
+        for (int t = 0; t < 2; ++t) {
+            PhaseResult& r = results[d][t];
+            std::sort(r.latencies_us.begin(), r.latencies_us.end());
+            std::cout << (t == 0 ? "tcp " : "unix") << " depth " << std::setw(4) << depths[d] << ": "
+                      << std::setw(10) << r.requests / r.seconds << " req/s | batch latency us: p50 "
+                      << percentile(r.latencies_us, 0.50) << " | p99 " << percentile(r.latencies_us, 0.99)
+                      << " | p99.9 " << percentile(r.latencies_us, 0.999) << std::endl;
+        }
+    }
+    return failures > 0 ? 2 : 0;
+}
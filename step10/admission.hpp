@@ -0,0 +1,37 @@
+#pragma once
+
+// Admission control for the thread-per-client servers: at most a fixed
+// number of commands run at once, and the rest wait for a slot in FIFO
+// order. Waiting is bounded CoDel-style. While the queue has been empty at
+// some point in the last interval, a burst is absorbed: a command may wait
+// a whole interval. Once the queue has stayed non-empty for an interval,
+// the server is overloaded and a command is turned away as soon as it has
+// waited the target, so queueing delay stays short instead of every client
+// timing out behind a standing queue.
+
+#define ADMISSION_INTERVAL_MS 100 // CoDel interval: how long a standing queue must last
+#define DEFAULT_QUEUE_TARGET_MS 5
+
+// max_inflight <= 0 turns admission control off
+void admission_configure(int max_inflight, int target_ms);
+
+// Takes a command slot; false when the command is shed and must not run
+bool admission_enter();
+void admission_leave();
+
+// Holds a slot for the lifetime of the scope, if one was wanted and granted
+class AdmissionSlot {
+public:
+    explicit AdmissionSlot(bool wanted) : held(wanted && admission_enter()), shed(wanted && !held) {}
+    ~AdmissionSlot() {
+        if (held) admission_leave();
+    }
+    AdmissionSlot(const AdmissionSlot&) = delete;
+    AdmissionSlot& operator=(const AdmissionSlot&) = delete;
+
+    bool rejected() const { return shed; }
+
+private:
+    bool held;
+    bool shed;
+};
@@ -2,9 +2,12 @@
 #include <iostream>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <cstddef>
 #include <cstring>
+#include <thread>
 
 int connect_to_server(const std::string& host, const std::string& port) {
     struct addrinfo hints{}, *servinfo, *p;
@@ -33,33 +36,53 @@ int connect_to_server(const std::string& host, const std::string& port) {
     return sockfd;
 }
 
-void run_client(int sockfd) {
-    char buf[1024];
-    ssize_t numbytes = recv(sockfd, buf, sizeof(buf) - 1, 0);
-    if (numbytes > 0) {
-        buf[numbytes] = '\0';
-        std::cout << buf;
+int connect_to_unix(const std::string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Bad Unix socket path: " << path << std::endl;
+        return -1;
     }
+    bool abstract = path[0] == '@';
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (abstract) addr.sun_path[0] = '\0';
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1);
+
+    int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd == -1) return -1;
+    if (connect(sockfd, (struct sockaddr*)&addr, len) == -1) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+void run_client(int sockfd) {
+    // Subscribe events can arrive at any time, so a reader thread prints
+    // everything the server sends while this thread forwards stdin
+    std::thread reader([sockfd] {
+        char buf[1024];
+        ssize_t numbytes;
+        while ((numbytes = recv(sockfd, buf, sizeof(buf), 0)) > 0) {
+            std::cout.write(buf, numbytes);
+            std::cout.flush();
+        }
+        std::cout << "Server closed connection.\n";
+    });
 
     std::string line;
-    while (true) {
-        std::cout << "> ";
-        if (!std::getline(std::cin, line)) break;
+    while (std::getline(std::cin, line)) {
         if (line == "Exit") break;
         line += "\n";
-        if (send(sockfd, line.c_str(), line.size(), 0) == -1) {
+        if (send(sockfd, line.c_str(), line.size(), MSG_NOSIGNAL) == -1) {
             std::cerr << "Send failed.\n";
             break;
         }
-        numbytes = recv(sockfd, buf, sizeof(buf) - 1, 0);
-        if (numbytes <= 0) {
-            std::cout << "Server closed connection.\n";
-            break;
-        }
-        buf[numbytes] = '\0';
-        std::cout << buf;
     }
 
+    shutdown(sockfd, SHUT_RDWR);
+    reader.join();
     close(sockfd);
     std::cout << "Disconnected.\n";
-}
\ No newline at end of file
+}
@@ -15,21 +15,28 @@ std::vector<Point> convex_hull(std::vector<Point>& points) {
     if (points.size() < 3) {
         throw std::invalid_argument("At least 3 points are required to compute a convex hull.");
     }
-    size_t n = points.size(), k = 0;
     std::sort(points.begin(), points.end());
-    std::vector<Point> hull(2 * n);
+    return convex_hull_sorted(points.data(), points.size());
+}
+
+std::vector<Point> convex_hull_sorted(const Point* points, size_t n) {
+    if (n < 3) {
+        throw std::invalid_argument("At least 3 points are required to compute a convex hull.");
+    }
+    // The hull is kept as a stack, so memory follows the hull, not n
+    std::vector<Point> hull;
 
     // Lower hull
     for (size_t i = 0; i < n; ++i) {
-        while (k >= 2 && cross(hull[k-2], hull[k-1], points[i]) <= 0) k--;
-        hull[k++] = points[i];
+        while (hull.size() >= 2 && cross(hull[hull.size()-2], hull.back(), points[i]) <= 0) hull.pop_back();
+        hull.push_back(points[i]);
     }
     // Upper hull
-    for (size_t i = n - 1, t = k + 1; i > 0; --i) {
-        while (k >= t && cross(hull[k-2], hull[k-1], points[i-1]) <= 0) k--;
-        hull[k++] = points[i-1];
+    for (size_t i = n - 1, t = hull.size() + 1; i > 0; --i) {
+        while (hull.size() >= t && cross(hull[hull.size()-2], hull.back(), points[i-1]) <= 0) hull.pop_back();
+        hull.push_back(points[i-1]);
     }
-    hull.resize(k - 1);
+    hull.pop_back();
     return hull;
 }
 
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <vector>
 
 struct Point {
@@ -7,4 +8,6 @@ struct Point {
 };
 
 std::vector<Point> convex_hull(std::vector<Point>& points);
+// Monotone chain over points already sorted by operator<; O(n), no copy
+std::vector<Point> convex_hull_sorted(const Point* points, size_t n);
 float convex_hull_area(const std::vector<Point>& hull);
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "graph_file.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define GRAPH_FILE_ALIGN 4096
+
+static uint32_t header_checksum(const GraphFileHeader& header) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&header);
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < offsetof(GraphFileHeader, checksum); ++i) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+GraphFile::~GraphFile() {
+    if (base) munmap(base, length);
+}
+
+static bool in_bounds(uint64_t offset, uint64_t count, size_t length) {
+    if (count == 0) return true;
+    return offset % alignof(Point) == 0 && offset <= length &&
+           count <= (length - offset) / sizeof(Point);
+}
+
+std::shared_ptr<const GraphFile> map_graph_file(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path.c_str());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(GraphFileHeader)) {
+        std::cerr << path << ": not a graph file" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return nullptr;
+    }
+
+    std::shared_ptr<GraphFile> file = std::make_shared<GraphFile>();
+    file->base = base;
+    file->length = st.st_size;
+
+    GraphFileHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, GRAPH_FILE_MAGIC, sizeof(GRAPH_FILE_MAGIC)) != 0 ||
+        header.checksum != header_checksum(header)) {
+        std::cerr << path << ": not a graph file" << std::endl;
+        return nullptr;
+    }
+    if (header.version != GRAPH_FILE_VERSION) {
+        std::cerr << path << ": unsupported graph file version " << header.version << std::endl;
+        return nullptr;
+    }
+    bool has_hull = header.flags & GRAPH_FILE_HULL;
+    if (!in_bounds(header.points_offset, header.point_count, file->length) ||
+        (has_hull && !in_bounds(header.hull_offset, header.hull_count, file->length))) {
+        std::cerr << path << ": truncated graph file" << std::endl;
+        return nullptr;
+    }
+
+    const char* bytes = static_cast<const char*>(base);
+    file->points = reinterpret_cast<const Point*>(bytes + header.points_offset);
+    file->point_count = header.point_count;
+    if (has_hull) {
+        file->hull = reinterpret_cast<const Point*>(bytes + header.hull_offset);
+        file->hull_count = header.hull_count;
+        file->hull_area = header.hull_area;
+    }
+    file->sorted = header.flags & GRAPH_FILE_SORTED;
+    return file;
+}
+
+static bool write_at(int fd, const void* data, size_t len, off_t offset) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool write_graph_file(const std::string& path, std::vector<Point> points, bool plain) {
+    GraphFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof(GRAPH_FILE_MAGIC));
+    header.version = GRAPH_FILE_VERSION;
+    header.point_count = points.size();
+    header.points_offset = GRAPH_FILE_ALIGN;
+
+    std::vector<Point> hull;
+    if (!plain) {
+        std::sort(points.begin(), points.end());
+        header.flags |= GRAPH_FILE_SORTED;
+        if (points.size() >= 3) {
+            hull = convex_hull_sorted(points.data(), points.size());
+            header.flags |= GRAPH_FILE_HULL;
+            header.hull_count = hull.size();
+            header.hull_offset = header.points_offset + points.size() * sizeof(Point);
+            header.hull_area = convex_hull_area(hull);
+        }
+    }
+    header.checksum = header_checksum(header);
+
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(tmp.c_str());
+        return false;
+    }
+    bool ok = write_at(fd, &header, sizeof(header), 0) &&
+              write_at(fd, points.data(), points.size() * sizeof(Point), header.points_offset) &&
+              write_at(fd, hull.data(), hull.size() * sizeof(Point), header.hull_offset) &&
+              fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) < 0) {
+        perror(path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
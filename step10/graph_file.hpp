@@ -0,0 +1,56 @@
+#pragma once
+#include "convex_hull.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Versioned on-disk graph format, mapped read-only at startup.
+//
+//   offset 0     GraphFileHeader
+//   points_offset  point_count packed Points (page aligned)
+//   hull_offset    hull_count packed Points, counter-clockwise (optional)
+//
+// With GRAPH_FILE_SORTED the point array is ordered by Point::operator<,
+// so a missing hull is one linear pass over the mapping. Readers reject
+// other versions instead of guessing at the layout.
+
+#define GRAPH_FILE_MAGIC "CHGRAPH"
+#define GRAPH_FILE_VERSION 1
+#define GRAPH_FILE_SORTED 0x1
+#define GRAPH_FILE_HULL 0x2
+
+struct GraphFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t point_count;
+    uint64_t points_offset;
+    uint64_t hull_count;
+    uint64_t hull_offset;
+    float hull_area;
+    uint32_t checksum; // Over the header bytes before this field
+};
+
+// A mapped graph file. Unmapped when the last reference goes away, so a
+// graph that switched to its own copy releases the mapping.
+struct GraphFile {
+    ~GraphFile();
+
+    const Point* points = nullptr;
+    size_t point_count = 0;
+    const Point* hull = nullptr; // nullptr when the file stores no hull
+    size_t hull_count = 0;
+    float hull_area = 0.0f;
+    bool sorted = false;
+
+    void* base = nullptr;
+    size_t length = 0;
+};
+
+// Maps path read-only and validates the header; O(1) in the point count.
+// Returns nullptr and prints the reason on failure.
+std::shared_ptr<const GraphFile> map_graph_file(const std::string& path);
+
+// Writes points to path, sorted and with their hull unless plain is set
+bool write_graph_file(const std::string& path, std::vector<Point> points, bool plain = false);
@@ -0,0 +1,46 @@
+#include "graph_file.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <unistd.h>
+
+// Writes a graph file for `server -f name=path`. Points come from stdin as
+// "x,y" lines (the Point line format) or, with -n, are random.
+int main(int argc, char* argv[]) {
+    long random_points = -1;
+    bool plain = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:u")) != -1) {
+        switch (opt) {
+        case 'n': random_points = std::atol(optarg); break;
+        case 'u': plain = true; break; // Store points as given, without a hull
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-n random_points] [-u] graph_file" << std::endl;
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        std::cerr << "Usage: " << argv[0] << " [-n random_points] [-u] graph_file" << std::endl;
+        return 1;
+    }
+
+    std::vector<Point> points;
+    if (random_points >= 0) {
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> coord(-1000.0f, 1000.0f);
+        points.resize(random_points);
+        for (Point& p : points) {
+            p.x = coord(rng);
+            p.y = coord(rng);
+        }
+    } else {
+        Point p;
+        while (std::scanf(" %f , %f", &p.x, &p.y) == 2) points.push_back(p);
+    }
+
+    size_t count = points.size();
+    if (!write_graph_file(argv[optind], std::move(points), plain)) return 1;
+    std::cout << "Wrote " << count << " points to " << argv[optind] << std::endl;
+    return 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include "convex_hull.hpp"
+#include "hull_query.hpp"
+#include "graph_file.hpp"
+#include "window_hull.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define DEFAULT_GRAPH "default"
+
+// Immutable view of a graph's hull, published after every mutation.
+// hull_valid is false after a hull vertex was removed, until the next
+// reader recomputes the hull from the full point set.
+struct GraphSnapshot {
+    uint64_t version = 0;
+    size_t point_count = 0;
+    bool hull_valid = true;
+    std::vector<Point> hull;
+    float hull_area = 0.0f;
+    // Derived by the first query after the hull changed, then carried
+    // over to later snapshots until it changes again
+    std::shared_ptr<const HullGeometry> geometry;
+    // Steady-clock time (ns) at which the oldest point of a time window ages
+    // out; 0 when nothing can. Readers past it expire points before answering.
+    int64_t expires_ns = 0;
+};
+
+// Keeps a graph to its newest max_points points and/or those younger than
+// max_seconds (0 = no such limit). The points then live in hull, oldest
+// first, instead of Graph::points, and the hull is maintained as they
+// arrive and expire.
+struct GraphWindow {
+    size_t max_points = 0;
+    double max_seconds = 0;
+    WindowHull hull;
+    std::deque<int64_t> arrival_ns; // Steady-clock arrival of each point, oldest first
+};
+
+struct HullFlight;
+
+// A named point set. Writers serialize on the graph's own mutex; readers
+// go through the published snapshot and never take a lock.
+struct Graph {
+    std::string name;
+    std::mutex mutex; // Serializes writers; protects points and version
+    std::vector<Point> points;
+    uint64_t version = 0;
+    uint64_t rewrites = 0; // Mutations other than appending points; protected by mutex
+    uint64_t journal_lsn = 0; // Last logged mutation; protected by mutex
+    // Read-only points of a mapped graph file, used instead of points until
+    // the first mutation copies them (copy-on-write); protected by mutex
+    std::shared_ptr<const GraphFile> mapped;
+    std::unique_ptr<GraphWindow> window; // Set by Window; protected by mutex
+    std::shared_ptr<HullFlight> hull_flight; // Hull rebuild running outside the lock; protected by mutex
+    std::atomic<const GraphSnapshot*> snapshot{nullptr}; // Reclaimed via epochs
+};
+
+// Returns the graph called name, creating an empty one on first use.
+// Graphs are never destroyed, so the pointer stays valid for the process lifetime.
+std::shared_ptr<Graph> get_graph(const std::string& name);
+
+// The graph called name, or null if no client has used it yet
+std::shared_ptr<Graph> find_graph(const std::string& name);
+
+// Visits every graph created so far. Takes only the name-map shard locks.
+void for_each_graph(const std::function<void(Graph&)>& fn);
+
+enum GraphMutation { MUTATION_RESET, MUTATION_ADD, MUTATION_REMOVE, MUTATION_WINDOW };
+
+// MUTATION_WINDOW carries its limits in the point: the bits of max_points
+// (as uint32_t) in x, max_seconds in y
+Point window_limits_point(size_t max_points, double max_seconds);
+void window_limits(const Point& p, size_t& max_points, double& max_seconds);
+
+// Applies a run of mutations to one graph under a single lock acquisition,
+// maintaining the hull incrementally, and publishes one snapshot at the end.
+class GraphWriteBatch {
+public:
+    explicit GraphWriteBatch(Graph& graph);
+    ~GraphWriteBatch(); // Publishes, unlocks, runs the change hook, then waits for the journal
+    GraphWriteBatch(const GraphWriteBatch&) = delete;
+    GraphWriteBatch& operator=(const GraphWriteBatch&) = delete;
+
+    void reset();
+    size_t add_point(const Point& p); // Returns the new point count
+    bool remove_point(const Point& p);
+    // Many points with one reserve and one hull update; returns the new point count
+    size_t add_points(const Point* points, size_t n);
+    // Each listed point removes one matching point, in one pass over the
+    // graph; returns how many were found
+    size_t remove_points(const Point* points, size_t n);
+    // Turns the graph into a window over its newest points (see GraphWindow),
+    // expiring any beyond the limits; both 0 turns it back into a plain
+    // graph. Returns the new point count.
+    size_t set_window(size_t max_points, double max_seconds);
+    // Drops points that have aged out of a time window
+    void expire();
+    // Bulk load for recovery, along with the graph's window limits (both 0
+    // for none); not journaled. A plain graph's hull is rebuilt on first read.
+    void replace_points(std::vector<Point> points, size_t window_points = 0, double window_seconds = 0);
+    // Serves the graph from a mapped file, taking its stored hull if any;
+    // not journaled, and drops any window. O(hull size).
+    void attach(std::shared_ptr<const GraphFile> file);
+
+private:
+    void journal(GraphMutation op, const Point& p);
+    void materialize();
+    void window_add(const Point* points, size_t n);
+    size_t window_remove(const Point* points, size_t n);
+    size_t window_expire(int64_t now, bool& hull_changed);
+    void window_publish(bool hull_changed);
+
+    Graph& graph;
+    std::unique_lock<std::mutex> lock;
+    GraphSnapshot* next; // Built up privately, published by the destructor
+    bool modified = false;
+    uint64_t last_lsn = 0;
+};
+
+// Single-mutation shorthands for GraphWriteBatch.
+void graph_reset(Graph& graph);
+size_t graph_add_point(Graph& graph, const Point& p); // Returns the new point count
+bool graph_remove_point(Graph& graph, const Point& p);
+size_t graph_add_points(Graph& graph, const Point* points, size_t n);
+size_t graph_remove_points(Graph& graph, const Point* points, size_t n);
+size_t graph_set_window(Graph& graph, size_t max_points, double max_seconds);
+
+// Lock-free unless the hull has to be rebuilt after a vertex removal or
+// points have aged out of a time window. Returns false when the graph has
+// fewer than 3 points.
+bool graph_hull_area(Graph& graph, float& area);
+
+// Runs query on a snapshot with a valid hull of at least 3 vertices and its
+// geometry. Lock-free unless the hull or geometry has to be derived first
+// or points have aged out of a time window.
+// Returns false (without calling query) when there is no such hull.
+bool graph_hull_query(Graph& graph, const std::function<void(const GraphSnapshot&)>& query);
+
+// Hull of the union of several graphs' point sets
+struct GraphUnion {
+    size_t point_count = 0;
+    std::vector<Point> hull;
+    float hull_area = 0.0f; // 0 when point_count < 3
+};
+
+// Merges the graphs' published hulls: the hull of a union is the hull of
+// the parts' hull vertices, so this costs O(H log H) for H vertices in all
+// rather than a pass over the points. Results are cached by the graphs'
+// versions; asking again before any of them changes is one lookup.
+std::shared_ptr<const GraphUnion> graph_union(const std::vector<std::shared_ptr<Graph>>& graphs);
+
+// Point and hull vertex counts from the published snapshot, without
+// locking. hull_vertices is 0 while the hull awaits a rebuild.
+void graph_sizes(Graph& graph, size_t& points, size_t& hull_vertices);
+
+// Called after every mutation, outside the graph lock.
+typedef void (*GraphChangeHook)(Graph* graph);
+void set_graph_change_hook(GraphChangeHook hook);
+
+// Write-ahead logging hooks. append runs under the graph lock for every
+// mutation and returns its log sequence number; wait (optional) runs after
+// the batch is published and unlocked, until that LSN is durable.
+typedef uint64_t (*GraphJournalAppend)(const Graph& graph, GraphMutation op, const Point& p);
+typedef void (*GraphJournalWait)(uint64_t lsn);
+void set_graph_journal(GraphJournalAppend append, GraphJournalWait wait);
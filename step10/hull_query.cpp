@@ -0,0 +1,300 @@
+#include "hull_query.hpp"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TWO_PI 6.283185307179586
+#define FAN_BUCKETS_PER_TRIANGLE 4
+
+// Double precision, so queries don't lose the sign float hull math kept
+static double cross(const Point& O, const Point& A, const Point& B) {
+    return (static_cast<double>(A.x) - O.x) * (static_cast<double>(B.y) - O.y) -
+           (static_cast<double>(A.y) - O.y) * (static_cast<double>(B.x) - O.x);
+}
+
+static double dot(const Point& O, const Point& A, double ux, double uy) {
+    return (static_cast<double>(A.x) - O.x) * ux + (static_cast<double>(A.y) - O.y) * uy;
+}
+
+static double distance(const Point& a, const Point& b) {
+    return std::hypot(static_cast<double>(a.x) - b.x, static_cast<double>(a.y) - b.y);
+}
+
+static float fan_slope(const HullFan& fan, float dx, float dy) {
+    float u = dx * fan.axis_x + dy * fan.axis_y;
+    float v = dy * fan.axis_x - dx * fan.axis_y;
+    return v / (u + std::fabs(v));
+}
+
+static void hull_fan(const std::vector<Point>& hull, HullFan& fan) {
+    size_t n = hull.size();
+    fan.origin = hull[0];
+    // hull[0]'s angle is under 180 degrees, so every other vertex is ahead
+    // of the bisector, and v / (u + |v|) in the bisector's frame increases
+    // with the angle. Unlike v / u it stays within (-1, 1) and nearly
+    // proportional to the angle, so equal-width buckets stay balanced.
+    double first = std::hypot(hull[1].x - hull[0].x, hull[1].y - hull[0].y);
+    double last = std::hypot(hull[n - 1].x - hull[0].x, hull[n - 1].y - hull[0].y);
+    double ax = (hull[1].x - hull[0].x) / first + (hull[n - 1].x - hull[0].x) / last;
+    double ay = (hull[1].y - hull[0].y) / first + (hull[n - 1].y - hull[0].y) / last;
+    double len = std::hypot(ax, ay);
+    fan.axis_x = static_cast<float>(ax / len);
+    fan.axis_y = static_cast<float>(ay / len);
+    fan.first_ray = {hull[1].x - hull[0].x, hull[1].y - hull[0].y};
+    fan.last_ray = {hull[n - 1].x - hull[0].x, hull[n - 1].y - hull[0].y};
+
+    fan.key.assign(n, 0.0f);
+    fan.edge_x.assign(n - 1, 0.0f);
+    fan.edge_y.assign(n - 1, 0.0f);
+    fan.edge_dx.assign(n - 1, 0.0f);
+    fan.edge_dy.assign(n - 1, 0.0f);
+    for (size_t i = 1; i < n; ++i) {
+        float dx = hull[i].x - fan.origin.x, dy = hull[i].y - fan.origin.y;
+        fan.key[i] = fan_slope(fan, dx, dy);
+        if (i + 1 < n) {
+            fan.edge_x[i] = hull[i].x;
+            fan.edge_y[i] = hull[i].y;
+            fan.edge_dx[i] = hull[i + 1].x - hull[i].x;
+            fan.edge_dy[i] = hull[i + 1].y - hull[i].y;
+        }
+    }
+
+    size_t buckets = std::max<size_t>(16, FAN_BUCKETS_PER_TRIANGLE * (n - 2));
+    fan.bucket_base = fan.key[1];
+    fan.bucket_scale = static_cast<float>(buckets / (static_cast<double>(fan.key[n - 1]) - fan.key[1]));
+    fan.bucket_triangle.resize(buckets);
+    for (size_t b = 0; b < buckets; ++b) {
+        float slope = fan.bucket_base + b / fan.bucket_scale;
+        size_t w = std::upper_bound(fan.key.begin() + 1, fan.key.end(), slope) - fan.key.begin() - 1;
+        fan.bucket_triangle[b] = static_cast<uint32_t>(std::min(std::max<size_t>(w, 1), n - 2));
+    }
+}
+
+void hull_geometry(const std::vector<Point>& hull, HullGeometry& geo) {
+    size_t n = hull.size();
+    geo = HullGeometry();
+    if (n < 3) return;
+
+    double perimeter = 0.0;
+    geo.normal_angle.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const Point& a = hull[i];
+        const Point& b = hull[(i + 1) % n];
+        perimeter += distance(a, b);
+        // Counter-clockwise, so the outward normal of (ex, ey) is (ey, -ex)
+        double angle = std::atan2(-(static_cast<double>(b.x) - a.x), static_cast<double>(b.y) - a.y);
+        while (i > 0 && angle < geo.normal_angle[i - 1]) angle += TWO_PI;
+        geo.normal_angle[i] = angle;
+    }
+    geo.perimeter = static_cast<float>(perimeter);
+
+    // One caliper rests on edge i; far, right and left track the vertices
+    // farthest from it, farthest along it and farthest back along it. Each
+    // only moves forward, so the whole walk is O(h).
+    size_t far = 0, right = 0, left = 0;
+    double best_diameter = -1.0, best_area = -1.0;
+    for (size_t i = 0; i < n; ++i) {
+        const Point& a = hull[i];
+        const Point& b = hull[(i + 1) % n];
+        double len = distance(a, b);
+        double ux = (static_cast<double>(b.x) - a.x) / len;
+        double uy = (static_cast<double>(b.y) - a.y) / len;
+        if (i == 0) {
+            for (size_t k = 1; k < n; ++k) {
+                if (cross(a, b, hull[k]) > cross(a, b, hull[far])) far = k;
+                if (dot(a, hull[k], ux, uy) > dot(a, hull[right], ux, uy)) right = k;
+                if (dot(a, hull[k], ux, uy) < dot(a, hull[left], ux, uy)) left = k;
+            }
+        }
+        for (size_t step = 0; step < n && cross(a, b, hull[(far + 1) % n]) > cross(a, b, hull[far]); ++step)
+            far = (far + 1) % n;
+        for (size_t step = 0; step < n && dot(a, hull[(right + 1) % n], ux, uy) > dot(a, hull[right], ux, uy); ++step)
+            right = (right + 1) % n;
+        for (size_t step = 0; step < n && dot(a, hull[(left + 1) % n], ux, uy) < dot(a, hull[left], ux, uy); ++step)
+            left = (left + 1) % n;
+
+        // The diameter is attained by an antipodal pair
+        for (const Point* end : {&a, &b}) {
+            double d = distance(*end, hull[far]);
+            if (d > best_diameter) {
+                best_diameter = d;
+                geo.diameter_ends[0] = *end;
+                geo.diameter_ends[1] = hull[far];
+            }
+        }
+
+        // Some minimum-area bounding rectangle has a side on a hull edge
+        double height = cross(a, b, hull[far]) / len;
+        double lo = dot(a, hull[left], ux, uy), hi = dot(a, hull[right], ux, uy);
+        double area = (hi - lo) * height;
+        if (best_area < 0.0 || area < best_area) {
+            best_area = area;
+            double nx = -uy * height, ny = ux * height;
+            geo.min_rect[0] = {static_cast<float>(a.x + ux * lo), static_cast<float>(a.y + uy * lo)};
+            geo.min_rect[1] = {static_cast<float>(a.x + ux * hi), static_cast<float>(a.y + uy * hi)};
+            geo.min_rect[2] = {static_cast<float>(a.x + ux * hi + nx), static_cast<float>(a.y + uy * hi + ny)};
+            geo.min_rect[3] = {static_cast<float>(a.x + ux * lo + nx), static_cast<float>(a.y + uy * lo + ny)};
+        }
+    }
+    geo.diameter = static_cast<float>(best_diameter);
+    geo.min_rect_area = static_cast<float>(best_area);
+    hull_fan(hull, geo.fan);
+}
+
+// Largest i in [1, n-2] with p not right of hull[0] -> hull[i]: p lies in
+// the triangle (hull[0], hull[i], hull[i+1]) if it is inside at all
+static size_t fan_wedge(const std::vector<Point>& hull, const Point& p) {
+    size_t lo = 1, hi = hull.size() - 1;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cross(hull[0], hull[mid], p) >= 0) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+HullSide hull_locate(const std::vector<Point>& hull, const Point& p) {
+    size_t n = hull.size();
+    if (cross(hull[0], hull[1], p) < 0 || cross(hull[0], hull[n - 1], p) > 0) return HULL_OUTSIDE;
+    size_t i = fan_wedge(hull, p);
+    double side = cross(hull[i], hull[i + 1], p);
+    if (side < 0) return HULL_OUTSIDE;
+    if (side == 0) return HULL_BOUNDARY;
+    if ((i == 1 && cross(hull[0], hull[1], p) == 0) || (i == n - 2 && cross(hull[0], hull[n - 1], p) == 0))
+        return HULL_BOUNDARY;
+    return HULL_INSIDE;
+}
+
+size_t hull_extreme(const std::vector<Point>& hull, const HullGeometry& geo, float dx, float dy) {
+    // Vertex i is extreme for directions between the normals of edges i-1 and i
+    const std::vector<double>& normals = geo.normal_angle;
+    double angle = std::atan2(static_cast<double>(dy), static_cast<double>(dx));
+    while (angle < normals[0]) angle += TWO_PI;
+    while (angle >= normals[0] + TWO_PI) angle -= TWO_PI;
+    size_t i = std::lower_bound(normals.begin(), normals.end(), angle) - normals.begin();
+    return i == hull.size() ? 0 : i;
+}
+
+bool hull_tangents(const std::vector<Point>& hull, const HullGeometry& geo, const Point& p,
+                   size_t& first, size_t& second) {
+    size_t n = hull.size();
+    // Edge i runs from hull[i] to hull[i+1]; p sees a contiguous run of them
+    auto visible = [&](size_t i) { return cross(hull[i], hull[(i + 1) % n], p) < 0; };
+
+    // A visible edge, from the same fan search as hull_locate
+    size_t seen;
+    if (cross(hull[0], hull[1], p) < 0) seen = 0;
+    else if (cross(hull[0], hull[n - 1], p) > 0) seen = n - 1;
+    else seen = fan_wedge(hull, p);
+    if (!visible(seen)) return false;
+
+    // A hidden edge: visible normals all lean towards p - c for an inside c,
+    // so one of the edges at the vertex extreme away from p is hidden
+    float cx = (hull[0].x + hull[1].x + hull[2].x) / 3.0f;
+    float cy = (hull[0].y + hull[1].y + hull[2].y) / 3.0f;
+    size_t away = hull_extreme(hull, geo, cx - p.x, cy - p.y);
+    size_t hidden = visible(away) ? (away + n - 1) % n : away;
+    if (visible(hidden)) return false; // Only by rounding, for p on the boundary
+
+    // Visibility flips once on each side between the two; binary search both
+    size_t lo = 0, hi = (hidden + n - seen) % n;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (visible((seen + mid) % n)) lo = mid;
+        else hi = mid;
+    }
+    second = (seen + lo + 1) % n; // End of the last visible edge
+    lo = 0;
+    hi = (seen + n - hidden) % n;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (visible((seen + n - mid) % n)) lo = mid;
+        else hi = mid;
+    }
+    first = (seen + n - lo) % n; // Start of the first visible edge
+    return true;
+}
+
+// Triangle for slope t of a point within the fan, starting from its
+// bucket's guess w. Slopes are rounded, so a point on an inner ray may get
+// the triangle on either side of it; both give the same answer there.
+static size_t fan_advance(const HullFan& fan, size_t w, float t) {
+    size_t last = fan.key.size() - 1;
+    if (w + 1 < last && t >= fan.key[w + 1]) ++w;
+    if (w + 1 < last && t >= fan.key[w + 1]) {
+        // Several rays share the bucket
+        w = std::upper_bound(fan.key.begin() + w + 1, fan.key.end() - 1, t) - fan.key.begin() - 1;
+    }
+    return w;
+}
+
+static size_t fan_triangle(const HullFan& fan, float t) {
+    float b = std::min(std::max((t - fan.bucket_base) * fan.bucket_scale, 0.0f),
+                       static_cast<float>(fan.bucket_triangle.size() - 1));
+    return fan_advance(fan, fan.bucket_triangle[static_cast<size_t>(b)], t);
+}
+
+static uint8_t classify_one(const HullFan& fan, const Point& p) {
+    float dx = p.x - fan.origin.x, dy = p.y - fan.origin.y;
+    if (dx == 0.0f && dy == 0.0f) return 1;
+    // The fan's bounds are tested exactly, not by slope
+    if (!(dx * fan.axis_x + dy * fan.axis_y > 0.0f) || fan.first_ray.x * dy - fan.first_ray.y * dx < 0.0f ||
+        fan.last_ray.x * dy - fan.last_ray.y * dx > 0.0f) return 0;
+    size_t w = fan_triangle(fan, fan_slope(fan, dx, dy));
+    float side = fan.edge_dx[w] * (p.y - fan.edge_y[w]) - fan.edge_dy[w] * (p.x - fan.edge_x[w]);
+    return side >= 0.0f;
+}
+
+void hull_classify(const HullFan& fan, const Point* points, size_t n, uint8_t* inside) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Lane k of each step is point i + k. The slopes, the fan and outer-edge
+    // sidedness tests run four points per instruction; only the triangle
+    // lookup is per lane.
+    const __m128 ox = _mm_set1_ps(fan.origin.x), oy = _mm_set1_ps(fan.origin.y);
+    const __m128 ax = _mm_set1_ps(fan.axis_x), ay = _mm_set1_ps(fan.axis_y);
+    const __m128 fx = _mm_set1_ps(fan.first_ray.x), fy = _mm_set1_ps(fan.first_ray.y);
+    const __m128 lx = _mm_set1_ps(fan.last_ray.x), ly = _mm_set1_ps(fan.last_ray.y);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 base = _mm_set1_ps(fan.bucket_base), scale = _mm_set1_ps(fan.bucket_scale);
+    const __m128 top = _mm_set1_ps(static_cast<float>(fan.bucket_triangle.size() - 1));
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(&points[i].x);     // x0 y0 x1 y1
+        __m128 b = _mm_loadu_ps(&points[i + 2].x); // x2 y2 x3 y3
+        __m128 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 dx = _mm_sub_ps(x, ox), dy = _mm_sub_ps(y, oy);
+        __m128 u = _mm_add_ps(_mm_mul_ps(dx, ax), _mm_mul_ps(dy, ay));
+        __m128 v = _mm_sub_ps(_mm_mul_ps(dy, ax), _mm_mul_ps(dx, ay));
+        __m128 abs_v = _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+        __m128 t = _mm_div_ps(v, _mm_add_ps(u, abs_v));
+        __m128 after_first = _mm_cmpge_ps(_mm_sub_ps(_mm_mul_ps(fx, dy), _mm_mul_ps(fy, dx)), zero);
+        __m128 before_last = _mm_cmple_ps(_mm_sub_ps(_mm_mul_ps(lx, dy), _mm_mul_ps(ly, dx)), zero);
+        __m128 in_fan = _mm_and_ps(_mm_cmpgt_ps(u, zero), _mm_and_ps(after_first, before_last));
+        __m128 at_origin = _mm_and_ps(_mm_cmpeq_ps(dx, zero), _mm_cmpeq_ps(dy, zero));
+        // Lanes outside the fan have junk slopes (even NaN, which max()
+        // turns into 0); they look up a valid bucket and are masked off below
+        __m128 bucket = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(t, base), scale), zero), top);
+
+        alignas(16) float slope[4], ex[4], ey[4], edx[4], edy[4];
+        alignas(16) int32_t guess[4];
+        _mm_store_ps(slope, t);
+        _mm_store_si128(reinterpret_cast<__m128i*>(guess), _mm_cvttps_epi32(bucket));
+        for (int k = 0; k < 4; ++k) {
+            size_t w = fan_advance(fan, fan.bucket_triangle[guess[k]], slope[k]);
+            ex[k] = fan.edge_x[w];
+            ey[k] = fan.edge_y[w];
+            edx[k] = fan.edge_dx[w];
+            edy[k] = fan.edge_dy[w];
+        }
+        __m128 side = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(edx), _mm_sub_ps(y, _mm_load_ps(ey))),
+                                 _mm_mul_ps(_mm_load_ps(edy), _mm_sub_ps(x, _mm_load_ps(ex))));
+        __m128 in = _mm_or_ps(_mm_and_ps(in_fan, _mm_cmpge_ps(side, zero)), at_origin);
+        int mask = _mm_movemask_ps(in);
+        for (int k = 0; k < 4; ++k) inside[i + k] = (mask >> k) & 1;
+    }
+#endif
+    for (; i < n; ++i) inside[i] = classify_one(fan, points[i]);
+}
@@ -0,0 +1,92 @@
+#include "listener.hpp"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+int open_tcp_listener(int port, int backlog, int flags) {
+    int listener = socket(AF_INET, SOCK_STREAM | flags, 0);
+    if (listener < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+    // Accepted sockets inherit it. Replies are small, and without it one
+    // waits for the client's delayed ACK of the previous one (~40 ms)
+    setsockopt(listener, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(listener);
+        return -1;
+    }
+    if (listen(listener, backlog) < 0) {
+        perror("listen");
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+// A socket file that refuses connections: its server is gone
+static bool stale_socket(const std::string& path, const struct sockaddr_un& addr, socklen_t len) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) < 0 || !S_ISSOCK(st.st_mode)) return false;
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) return false;
+    bool refused = connect(probe, (const struct sockaddr*)&addr, len) < 0 && errno == ECONNREFUSED;
+    close(probe);
+    return refused;
+}
+
+int open_unix_listener(const std::string& path, int backlog, int flags) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path == "@" || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Bad Unix socket path: " << path << std::endl;
+        return -1;
+    }
+    bool abstract = path[0] == '@';
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (abstract) addr.sun_path[0] = '\0'; // The name is the bytes after the NUL, no terminator
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | flags, 0);
+    if (listener < 0) {
+        perror("socket (unix)");
+        return -1;
+    }
+    int rc = bind(listener, (struct sockaddr*)&addr, len);
+    if (rc < 0 && errno == EADDRINUSE && !abstract && stale_socket(path, addr, len)) {
+        unlink(path.c_str());
+        rc = bind(listener, (struct sockaddr*)&addr, len);
+    }
+    if (rc < 0) {
+        perror("bind (unix)");
+        close(listener);
+        return -1;
+    }
+    if (listen(listener, backlog) < 0) {
+        perror("listen (unix)");
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
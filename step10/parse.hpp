@@ -0,0 +1,67 @@
+#pragma once
+#include "convex_hull.hpp"
+#include <string_view>
+#include <vector>
+
+// Request parsing without allocation: a line is split once into
+// string_view tokens over the caller's buffer, the command name is
+// resolved by a switch on its length, and numbers go through
+// std::from_chars.
+
+#define MAX_COMMAND_ARGS 4 // Further tokens are ignored
+
+enum CommandId {
+    CMD_UNKNOWN,
+    CMD_NEWGRAPH,
+    CMD_NEWPOINT,
+    CMD_REMOVEPOINT,
+    CMD_CH,
+    CMD_USE,
+    CMD_SUBSCRIBE,
+    CMD_UNSUBSCRIBE,
+    CMD_STATS,
+    CMD_NEWPOINTS,
+    CMD_REMOVEPOINTS,
+    CMD_INSIDE,
+    CMD_EXTREME,
+    CMD_TANGENTS,
+    CMD_PERIMETER,
+    CMD_DIAMETER,
+    CMD_MINRECT,
+    CMD_CLASSIFY,
+    CMD_WINDOW,
+    CMD_UNION
+};
+
+struct CommandLine {
+    CommandId id = CMD_UNKNOWN;
+    std::string_view name; // Empty for a blank line
+    std::string_view args[MAX_COMMAND_ARGS];
+    int argc = 0;
+    std::string_view rest; // Everything after the name, for unbounded argument lists
+};
+
+CommandId command_id(std::string_view name);
+
+// Tokenizes line on whitespace; the views point into line
+void parse_command(std::string_view line, CommandLine& cmd);
+
+// The whole token must be the number; n must be at least 1
+bool parse_count(std::string_view token, int& n);
+bool parse_float(std::string_view token, float& value);
+
+// "x,y" or "x y"; commas and blanks both separate, and anything after y
+// is ignored, as the stream-based parser did
+bool parse_point(std::string_view text, Point& p);
+
+// Whitespace-separated "x,y" tokens, as in "Newpoints 1,2 3,4". Replaces the
+// contents of points; false (and nothing usable) if any token is malformed
+// or there are none.
+bool parse_points(std::string_view text, std::vector<Point>& points);
+
+// Pops the next whitespace-separated token off text; false when none is left
+bool next_token(std::string_view& text, std::string_view& token);
+
+// Pops the next newline-terminated line off input, without "\n" or "\r\n";
+// false when input holds no complete line
+bool next_line(std::string_view& input, std::string_view& line);
@@ -0,0 +1,463 @@
+#include "replication.hpp"
+#include "graph_store.hpp"
+#include "metrics.hpp"
+#include "wal.hpp"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#define REPL_MAGIC "CHREPL01"
+#define REPL_HEARTBEAT_MS 1000
+#define REPL_RETRY_MS 1000
+#define REPL_MAX_QUEUED_BYTES (256 << 20) // A follower further behind is dropped and resyncs
+#define REPL_MAX_SNAPSHOT_BYTES (8ULL << 30) // Largest snapshot frame either side accepts
+
+enum ReplFrameType { FRAME_SNAPSHOT = 1, FRAME_RECORDS, FRAME_HEARTBEAT };
+
+// Every frame is this header followed by length payload bytes. lsn is the
+// last LSN the leader had shipped, sent_ns its steady clock when the frame
+// was queued (comparable across processes on one host).
+struct ReplFrameHeader {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t length;
+    uint64_t lsn;
+    uint64_t sent_ns;
+};
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool is_unix_path(const std::string& address) {
+    return address.find('/') != std::string::npos;
+}
+
+static bool send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Payload limit per frame type; a header over it is corrupt or hostile and
+// must not size an allocation. Records frames never exceed a follower queue.
+static uint64_t max_frame_length(uint32_t type) {
+    switch (type) {
+    case FRAME_SNAPSHOT: return REPL_MAX_SNAPSHOT_BYTES;
+    case FRAME_RECORDS: return REPL_MAX_QUEUED_BYTES;
+    default: return 0; // Heartbeats carry nothing
+    }
+}
+
+static ReplFrameHeader frame_header(uint32_t type, uint64_t lsn, size_t length) {
+    ReplFrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = type;
+    header.length = length;
+    header.lsn = lsn;
+    header.sent_ns = now_ns();
+    return header;
+}
+
+static std::shared_ptr<const std::string> make_frame(uint32_t type, uint64_t lsn, const char* payload, size_t len) {
+    ReplFrameHeader header = frame_header(type, lsn, len);
+    std::shared_ptr<std::string> frame = std::make_shared<std::string>();
+    frame->reserve(sizeof(header) + len);
+    frame->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    frame->append(payload, len);
+    return frame;
+}
+
+// ---------------------------------------------------------------- Leader
+
+// One connected follower. Its sender thread drains queue; the WAL flusher
+// only appends, so a slow follower never holds up the log.
+struct FollowerLink {
+    explicit FollowerLink(int fd) : fd(fd) {}
+    int fd;
+    std::deque<std::shared_ptr<const std::string>> queue;
+    size_t queued_bytes = 0;
+    uint64_t sent_lsn = 0;
+    bool dropped = false; // Fell REPL_MAX_QUEUED_BYTES behind
+};
+
+static std::mutex leader_mutex; // Protects everything below
+static std::condition_variable leader_cond;
+static std::set<std::shared_ptr<FollowerLink>> followers;
+static uint64_t shipped_lsn = 0;
+static bool leader_mode = false;
+
+// WalShipper: runs on the WAL flusher thread, so it only queues
+static void ship_records(const char* records, size_t len, uint64_t last_lsn) {
+    std::shared_ptr<const std::string> frame = make_frame(FRAME_RECORDS, last_lsn, records, len);
+    std::lock_guard<std::mutex> lock(leader_mutex);
+    shipped_lsn = last_lsn;
+    for (const std::shared_ptr<FollowerLink>& link : followers) {
+        if (link->dropped) continue;
+        if (link->queued_bytes + frame->size() > REPL_MAX_QUEUED_BYTES) {
+            link->dropped = true;
+            shutdown(link->fd, SHUT_RDWR); // Unblocks a send in progress
+            continue;
+        }
+        link->queue.push_back(frame);
+        link->queued_bytes += frame->size();
+    }
+    leader_cond.notify_all();
+}
+
+static void follower_sender(std::shared_ptr<FollowerLink> link) {
+    uint64_t snapshot_lsn;
+    {
+        std::lock_guard<std::mutex> lock(leader_mutex);
+        followers.insert(link);
+        snapshot_lsn = shipped_lsn;
+    }
+    // Registered first: whatever the snapshot misses is already being queued
+    std::string snapshot = wal_encode_snapshot();
+    ReplFrameHeader header = frame_header(FRAME_SNAPSHOT, snapshot_lsn, snapshot.size());
+    if (snapshot.size() > REPL_MAX_SNAPSHOT_BYTES) {
+        std::cerr << "replication: snapshot of " << snapshot.size() << " bytes is over the frame limit" << std::endl;
+    }
+    bool ok = snapshot.size() <= REPL_MAX_SNAPSHOT_BYTES && send_all(link->fd, REPL_MAGIC, strlen(REPL_MAGIC)) &&
+              send_all(link->fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+              send_all(link->fd, snapshot.data(), snapshot.size());
+    std::string().swap(snapshot);
+    if (ok) {
+        std::lock_guard<std::mutex> lock(leader_mutex);
+        link->sent_lsn = snapshot_lsn;
+    }
+
+    while (ok) {
+        std::shared_ptr<const std::string> frame;
+        {
+            std::unique_lock<std::mutex> lock(leader_mutex);
+            leader_cond.wait_for(lock, std::chrono::milliseconds(REPL_HEARTBEAT_MS),
+                [&link]{ return link->dropped || !link->queue.empty(); });
+            if (link->dropped) break;
+            if (!link->queue.empty()) {
+                frame = link->queue.front();
+                link->queue.pop_front();
+                link->queued_bytes -= frame->size();
+            } else {
+                frame = make_frame(FRAME_HEARTBEAT, shipped_lsn, nullptr, 0);
+            }
+        }
+        ok = send_all(link->fd, frame->data(), frame->size());
+        if (ok) {
+            ReplFrameHeader sent;
+            memcpy(&sent, frame->data(), sizeof(sent));
+            std::lock_guard<std::mutex> lock(leader_mutex);
+            link->sent_lsn = sent.lsn;
+        }
+    }
+
+    bool dropped;
+    {
+        std::lock_guard<std::mutex> lock(leader_mutex);
+        followers.erase(link);
+        dropped = link->dropped;
+    }
+    close(link->fd);
+    if (dropped) {
+        std::cout << "Follower (fd=" << link->fd << ") fell too far behind; dropped to resynchronize" << std::endl;
+    } else {
+        std::cout << "Follower disconnected (fd=" << link->fd << ")" << std::endl;
+    }
+}
+
+static void replication_listener_thread(int listener) {
+    while (true) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("accept (replication)");
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+        std::cout << "Follower connected (fd=" << fd << ")" << std::endl;
+        std::thread(follower_sender, std::make_shared<FollowerLink>(fd)).detach();
+    }
+}
+
+// The stream is unauthenticated, so TCP listens on loopback only
+static int listen_on(const std::string& address) {
+    int listener;
+    if (is_unix_path(address)) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Replication socket path too long: " << address << std::endl;
+            return -1;
+        }
+        strcpy(addr.sun_path, address.c_str());
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            perror("socket (replication)");
+            return -1;
+        }
+        unlink(address.c_str()); // Left behind by a previous leader
+        if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("replication listener");
+            close(listener);
+            return -1;
+        }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(std::atoi(address.c_str()));
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            perror("socket (replication)");
+            return -1;
+        }
+        int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+        if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("replication listener");
+            close(listener);
+            return -1;
+        }
+    }
+    if (listen(listener, 16) < 0) {
+        perror("listen (replication)");
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+bool start_replication_leader(const std::string& address) {
+    int listener = listen_on(address);
+    if (listener < 0) return false;
+    {
+        std::lock_guard<std::mutex> lock(leader_mutex);
+        leader_mode = true;
+        shipped_lsn = wal_last_lsn();
+    }
+    set_wal_shipper(ship_records);
+    std::thread(replication_listener_thread, listener).detach();
+    std::cout << "Replicating to followers on " << address << std::endl;
+    return true;
+}
+
+// -------------------------------------------------------------- Follower
+
+static std::mutex follower_mutex; // Protects everything below
+static bool follower_mode = false;
+static std::string leader_address;
+static bool connected = false;
+static uint64_t applied_lsn = 0;
+static uint64_t last_frame_ns = 0; // Leader's queue time of the newest applied frame
+
+static int connect_to(const std::string& address) {
+    if (is_unix_path(address)) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, address.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    size_t colon = address.rfind(':');
+    std::string host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+    std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+    struct addrinfo hints{}, *servinfo, *p;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &servinfo) != 0) return -1;
+    int fd = -1;
+    for (p = servinfo; p != nullptr; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype | SOCK_CLOEXEC, p->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(servinfo);
+    return fd;
+}
+
+// Applies the stream until it breaks
+static void follow(int fd) {
+    char magic[sizeof(REPL_MAGIC) - 1];
+    if (!recv_all(fd, magic, sizeof(magic)) || memcmp(magic, REPL_MAGIC, sizeof(magic)) != 0) {
+        std::cerr << "replication: " << leader_address << " is not a replication leader" << std::endl;
+        return;
+    }
+    ReplFrameHeader header;
+    std::string payload;
+    while (recv_all(fd, reinterpret_cast<char*>(&header), sizeof(header))) {
+        if (header.length > max_frame_length(header.type)) {
+            std::cerr << "replication: frame of " << header.length << " bytes (type " << header.type
+                      << ") is over its limit; resynchronizing" << std::endl;
+            return;
+        }
+        payload.resize(header.length);
+        if (!recv_all(fd, &payload[0], payload.size())) return;
+        size_t graphs = 0, points = 0, applied = 0;
+        switch (header.type) {
+        case FRAME_SNAPSHOT:
+            if (!wal_apply_snapshot(payload, graphs, points)) return;
+            std::cout << "Synchronized " << graphs << " graphs (" << points
+                      << " points) from the leader at LSN " << header.lsn << std::endl;
+            break;
+        case FRAME_RECORDS:
+            if (!wal_apply_records(payload.data(), payload.size(), applied)) {
+                std::cerr << "replication: corrupt log batch from the leader" << std::endl;
+                return;
+            }
+            metrics_observe(HIST_REPLICATION_LAG, now_ns() - header.sent_ns);
+            break;
+        case FRAME_HEARTBEAT:
+            break;
+        default:
+            std::cerr << "replication: unknown frame type " << header.type << std::endl;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(follower_mutex);
+        applied_lsn = header.lsn;
+        last_frame_ns = header.sent_ns;
+    }
+}
+
+// Only this thread writes graphs on a follower
+static void follower_thread() {
+    bool reported = false; // One message per outage, not one per retry
+    while (true) {
+        int fd = connect_to(leader_address);
+        if (fd >= 0) {
+            std::cout << "Following the leader at " << leader_address << std::endl;
+            {
+                std::lock_guard<std::mutex> lock(follower_mutex);
+                connected = true;
+            }
+            follow(fd);
+            close(fd);
+            {
+                std::lock_guard<std::mutex> lock(follower_mutex);
+                connected = false;
+            }
+            std::cout << "Lost the leader at " << leader_address << "; serving the last state meanwhile" << std::endl;
+            reported = true;
+        } else if (!reported) {
+            std::cerr << "replication: cannot reach the leader at " << leader_address << "; retrying" << std::endl;
+            reported = true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(REPL_RETRY_MS));
+    }
+}
+
+void start_replication_follower(const std::string& address) {
+    {
+        std::lock_guard<std::mutex> lock(follower_mutex);
+        follower_mode = true;
+        leader_address = address;
+    }
+    std::thread(follower_thread).detach();
+}
+
+// ------------------------------------------------------------- Reporting
+
+// Records the slowest follower has yet to be sent
+static uint64_t max_follower_lag() {
+    uint64_t lag = 0;
+    for (const std::shared_ptr<FollowerLink>& link : followers) {
+        if (shipped_lsn > link->sent_lsn) lag = std::max(lag, shipped_lsn - link->sent_lsn);
+    }
+    return lag;
+}
+
+static double staleness_seconds() {
+    return last_frame_ns ? (now_ns() - last_frame_ns) / 1e9 : 0.0;
+}
+
+std::string replication_report() {
+    std::ostringstream out;
+    {
+        std::lock_guard<std::mutex> lock(leader_mutex);
+        if (leader_mode) {
+            out << "Replication: leader, " << followers.size() << " followers, shipped LSN " << shipped_lsn
+                << ", slowest follower " << max_follower_lag() << " records behind\n";
+        }
+    }
+    std::lock_guard<std::mutex> lock(follower_mutex);
+    if (follower_mode) {
+        out << "Replication: following " << leader_address << (connected ? " (connected)" : " (disconnected)")
+            << ", applied LSN " << applied_lsn << ", last frame " << staleness_seconds() << " s ago\n";
+    }
+    return out.str();
+}
+
+std::string replication_prometheus() {
+    std::ostringstream out;
+    {
+        std::lock_guard<std::mutex> lock(leader_mutex);
+        if (leader_mode) {
+            out << "# TYPE ch_replication_followers gauge\n"
+                << "ch_replication_followers " << followers.size() << "\n"
+                << "# TYPE ch_replication_shipped_lsn gauge\n"
+                << "ch_replication_shipped_lsn " << shipped_lsn << "\n"
+                << "# TYPE ch_replication_max_lag_records gauge\n"
+                << "ch_replication_max_lag_records " << max_follower_lag() << "\n";
+        }
+    }
+    std::lock_guard<std::mutex> lock(follower_mutex);
+    if (follower_mode) {
+        // Heartbeats bound the staleness of a caught-up follower to ~REPL_HEARTBEAT_MS
+        out << "# TYPE ch_replication_connected gauge\n"
+            << "ch_replication_connected " << (connected ? 1 : 0) << "\n"
+            << "# TYPE ch_replication_applied_lsn gauge\n"
+            << "ch_replication_applied_lsn " << applied_lsn << "\n"
+            << "# TYPE ch_replication_staleness_seconds gauge\n"
+            << "ch_replication_staleness_seconds " << staleness_seconds() << "\n";
+    }
+    return out.str();
+}
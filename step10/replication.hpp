@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+
+// Leader/follower replication over the write-ahead log.
+//
+// The leader ships every log batch its WAL flusher writes to each
+// connected follower. A new follower first receives a snapshot of all
+// graphs, taken after it was registered for the log stream, then the
+// log from there on; records a snapshotted graph already includes are
+// skipped by LSN, as in crash recovery. Followers apply the stream as
+// their only writer and serve reads; they reconnect and resynchronize
+// from a fresh snapshot whenever the stream breaks.
+//
+// Addresses are a TCP port (leader) or host:port (follower), or a
+// filesystem path (anything containing '/') for a Unix socket.
+
+// Serves the log stream on address. Requires a running WAL.
+bool start_replication_leader(const std::string& address);
+
+// Follows the leader at address in the background
+void start_replication_follower(const std::string& address);
+
+// "Replication: ..." line for STATS; empty when replication is off
+std::string replication_report();
+
+// Prometheus gauges for the replication role; empty when replication is off
+std::string replication_prometheus();
@@ -1,6 +1,12 @@
 #include "server.hpp"
 #include "convex_hull.hpp"
+#include "graph_actor.hpp"
+#include "metrics.hpp"
+#include "format.hpp"
+#include "parse.hpp"
+#include "listener.hpp"
 #include "reactor_proactor.hpp"
+#include "replication.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -12,235 +18,830 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <set>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <poll.h>
 
-#define BACKLOG 10
 #define BUFSIZE 1024
+#define MAX_HELD_EVENTS 65536 // Event bytes held behind a stalled reply before the subscriber is dropped
 
-static std::vector<Point> points;
-static std::map<int, int> points_to_read;
-static std::mutex points_mutex; 
-static std::condition_variable_any ch_cond;
+static std::mutex monitor_mutex;
+static std::condition_variable monitor_cond;
+// Graphs mutated since the monitor last looked, with their first change time
+static std::map<Graph*, std::chrono::steady_clock::time_point> changed_graphs;
 
-std::string handle_command(const std::string& cmdline) {
-    std::istringstream iss(cmdline);
-    std::string cmd;
-    iss >> cmd;
-    std::ostringstream response;
+// A Subscribe registration. While the area is below its threshold it sits
+// in "below" keyed by the threshold; once reached it moves to "above" keyed
+// by threshold - hysteresis, so the monitor only touches crossed entries.
+struct Subscription {
+    std::shared_ptr<Connection> conn;
+    float threshold;
+    float hysteresis;
+};
 
-    std::lock_guard<std::mutex> lock(points_mutex);
+struct GraphSubscriptions {
+    std::multimap<float, Subscription> below; // Fires when area >= key
+    std::multimap<float, Subscription> above; // Fires when area < key
+};
 
-    if (cmd == "Newgraph") {
+static std::mutex subs_mutex; // Never held while computing an area
+static std::map<Graph*, GraphSubscriptions> subscriptions;
+
+static bool actor_mode = false; // Mutations go through the graph owner thread
+static bool read_only = false;  // A follower; the replication stream is the only writer
+
+static void reset_graph(Graph& graph) {
+    if (actor_mode) actor_reset(graph);
+    else graph_reset(graph);
+}
+
+static size_t add_point(Graph& graph, const Point& p) {
+    return actor_mode ? actor_add_point(graph, p) : graph_add_point(graph, p);
+}
+
+static bool remove_point(Graph& graph, const Point& p) {
+    return actor_mode ? actor_remove_point(graph, p) : graph_remove_point(graph, p);
+}
+
+static size_t add_points(Graph& graph, const std::vector<Point>& points) {
+    return actor_mode ? actor_add_points(graph, points.data(), points.size())
+                      : graph_add_points(graph, points.data(), points.size());
+}
+
+static size_t remove_points(Graph& graph, const std::vector<Point>& points) {
+    return actor_mode ? actor_remove_points(graph, points.data(), points.size())
+                      : graph_remove_points(graph, points.data(), points.size());
+}
+
+static size_t set_window(Graph& graph, size_t max_points, double max_seconds) {
+    return actor_mode ? actor_set_window(graph, max_points, max_seconds)
+                      : graph_set_window(graph, max_points, max_seconds);
+}
+
+// Applies the point lines staged since the last commit as one mutation;
+// returns the graph's point count afterwards
+static size_t commit_staged(ClientSession& session) {
+    size_t count = add_points(*session.graph, session.staged);
+    session.staged.clear();
+    return count;
+}
+
+static bool send_all(int fd, const char* data, size_t len, int flags) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, flags | MSG_NOSIGNAL);
+        if (n == -1) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Sends data without blocking under send_mutex: while the socket is full
+// the lock is released, so the monitor never waits for a client that isn't
+// reading its replies. Caller holds lock.
+static void send_unlocking(Connection& conn, std::unique_lock<std::mutex>& lock, const std::string& data) {
+    size_t sent = 0;
+    while (conn.open && sent < data.size()) {
+        ssize_t n = send(conn.fd, data.data() + sent, data.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) break;
+        conn.stalled = true; // Mid-line: events are held until the reply is done
+        lock.unlock();
+        struct pollfd pfd = {conn.fd, POLLOUT, 0};
+        poll(&pfd, 1, -1); // Only this thread closes fd
+        lock.lock();
+    }
+    metrics_add(CTR_BYTES_OUT, sent);
+}
+
+static void send_reply(Connection& conn, const std::string& data) {
+    std::unique_lock<std::mutex> lock(conn.send_mutex);
+    send_unlocking(conn, lock, data);
+    // Events that arrived while the reply was stalled follow it
+    while (conn.open && !conn.held_events.empty()) {
+        std::string events;
+        events.swap(conn.held_events);
+        send_unlocking(conn, lock, events);
+    }
+    conn.stalled = false;
+}
+
+// Called by the monitor under subs_mutex, so it never waits on a client.
+// An event behind a stalled reply is held and sent after it. A subscriber
+// whose socket can't take the whole event, or with too much held, isn't
+// reading: it is disconnected rather than left with a subscription whose
+// state no longer matches what it was told. Returns false once conn is closed.
+static bool push_event(Connection& conn, const std::string& event) {
+    std::lock_guard<std::mutex> lock(conn.send_mutex);
+    if (!conn.open) return false;
+    if (conn.stalled) {
+        if (conn.held_events.size() + event.size() <= MAX_HELD_EVENTS) {
+            conn.held_events += event;
+            return true;
+        }
+    } else {
+        ssize_t n = send(conn.fd, event.data(), event.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) metrics_add(CTR_BYTES_OUT, n);
+        if (n == static_cast<ssize_t>(event.size())) return true;
+    }
+    std::cout << "Subscriber fd=" << conn.fd << " is not reading, disconnecting\n";
+    shutdown(conn.fd, SHUT_RDWR); // Its client thread sees EOF and closes fd
+    conn.open = false;
+    return false;
+}
+
+// At the connection cap: say why instead of leaving the client in the backlog
+static void* reject_client(int client_fd) {
+    static const char busy[] = "BUSY Too many connections, try again later.\n";
+    send(client_fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(client_fd);
+    metrics_add(CTR_CONNECTIONS_SHED);
+    return nullptr;
+}
+
+static std::string graph_label(const Graph* graph) {
+    return graph->name == DEFAULT_GRAPH ? "" : " (graph " + graph->name + ")";
+}
+
+static float current_area(Graph& graph) {
+    float area = 0.0f;
+    try {
+        graph_hull_area(graph, area);
+    } catch (...) {}
+    return area;
+}
+
+static void on_graph_changed(Graph* graph) {
+    {
+        std::lock_guard<std::mutex> lock(monitor_mutex);
+        changed_graphs.insert(std::make_pair(graph, std::chrono::steady_clock::now()));
+    }
+    monitor_cond.notify_one();
+}
+
+// Returns true when the area is already at or above threshold. The area is
+// read without subs_mutex, since it may rebuild the hull, so it can be stale
+// by the time the subscription is filed; the monitor is asked to look again,
+// and a crossing missed in between becomes an event.
+static bool subscribe(Graph& graph, const std::shared_ptr<Connection>& conn,
+                      float threshold, float hysteresis, float& area) {
+    area = current_area(graph);
+    bool above = area >= threshold;
+    {
+        std::lock_guard<std::mutex> lock(subs_mutex);
+        GraphSubscriptions& subs = subscriptions[&graph];
+        Subscription sub = {conn, threshold, hysteresis};
+        if (above) subs.above.emplace(threshold - hysteresis, sub);
+        else subs.below.emplace(threshold, sub);
+    }
+    on_graph_changed(&graph);
+    return above;
+}
+
+// Returns how many subscriptions conn had
+static size_t unsubscribe(const Connection* conn) {
+    std::lock_guard<std::mutex> lock(subs_mutex);
+    size_t removed = 0;
+    for (auto& entry : subscriptions) {
+        for (auto* subs : {&entry.second.below, &entry.second.above}) {
+            for (auto it = subs->begin(); it != subs->end();) {
+                if (it->second.conn.get() == conn) {
+                    it = subs->erase(it);
+                    ++removed;
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+    return removed;
+}
+
+// One ordered pass per graph change: a prefix of "below" and a suffix of
+// "above" are the only entries whose threshold was crossed. Returns the
+// area it evaluated. Only the monitor calls it, so the area can be read
+// before taking subs_mutex.
+static float notify_subscribers(Graph* graph) {
+    float area = current_area(*graph);
+    std::lock_guard<std::mutex> lock(subs_mutex);
+    auto found = subscriptions.find(graph);
+    if (found == subscriptions.end()) return area;
+    GraphSubscriptions& subs = found->second;
+
+    auto rising_end = subs.below.upper_bound(area);
+    for (auto it = subs.below.begin(); it != rising_end; it = subs.below.erase(it)) {
+        Subscription& sub = it->second;
+        std::string event = "Event: CH area ";
+        append_float(event, area);
+        event += " reached ";
+        append_float(event, sub.threshold);
+        event += graph_label(graph);
+        event += '\n';
+        if (push_event(*sub.conn, event)) {
+            subs.above.emplace(sub.threshold - sub.hysteresis, std::move(sub));
+        }
+    }
+    for (auto it = subs.above.upper_bound(area); it != subs.above.end(); it = subs.above.erase(it)) {
+        Subscription& sub = it->second;
+        std::string event = "Event: CH area ";
+        append_float(event, area);
+        event += " dropped below ";
+        append_float(event, it->first);
+        event += graph_label(graph);
+        event += '\n';
+        if (push_event(*sub.conn, event)) {
+            subs.below.emplace(sub.threshold, std::move(sub));
+        }
+    }
+    return area;
+}
+
+// Inside/Extreme/Tangents X,Y and Perimeter/Diameter/MinRect, answered from
+// the published hull and its cached geometry; none touches the point set
+static void hull_query(Graph& graph, const CommandLine& cmd, std::string& out) {
+    bool takes_point = cmd.id == CMD_INSIDE || cmd.id == CMD_EXTREME || cmd.id == CMD_TANGENTS;
+    Point p = {0.0f, 0.0f};
+    if (takes_point && (cmd.argc < 1 || !parse_point(cmd.args[0], p) ||
+                        (cmd.id == CMD_EXTREME && p.x == 0.0f && p.y == 0.0f))) {
+        out += "Invalid usage. Example: ";
+        out += cmd.name;
+        out += " 1,2\n";
+        return;
+    }
+    bool answered = graph_hull_query(graph, [&](const GraphSnapshot& snap) {
+        const std::vector<Point>& hull = snap.hull;
+        const HullGeometry& geo = *snap.geometry;
+        switch (cmd.id) {
+        case CMD_INSIDE: {
+            HullSide side = hull_locate(hull, p);
+            out += "Point ";
+            append_point(out, p.x, p.y);
+            out += side == HULL_INSIDE ? " is inside the hull.\n"
+                 : side == HULL_BOUNDARY ? " is on the hull boundary.\n" : " is outside the hull.\n";
+            break;
+        }
+        case CMD_EXTREME: {
+            const Point& v = hull[hull_extreme(hull, geo, p.x, p.y)];
+            out += "Extreme vertex toward ";
+            append_point(out, p.x, p.y);
+            out += ": ";
+            append_point(out, v.x, v.y);
+            out += '\n';
+            break;
+        }
+        case CMD_TANGENTS: {
+            size_t first, second;
+            out += "Point ";
+            append_point(out, p.x, p.y);
+            if (!hull_tangents(hull, geo, p, first, second)) {
+                out += " is not outside the hull.\n";
+                break;
+            }
+            out += " touches the hull at ";
+            append_point(out, hull[first].x, hull[first].y);
+            out += " and ";
+            append_point(out, hull[second].x, hull[second].y);
+            out += '\n';
+            break;
+        }
+        case CMD_PERIMETER:
+            out += "Convex hull perimeter: ";
+            append_float(out, geo.perimeter);
+            out += '\n';
+            break;
+        case CMD_DIAMETER:
+            out += "Convex hull diameter: ";
+            append_float(out, geo.diameter);
+            out += " from ";
+            append_point(out, geo.diameter_ends[0].x, geo.diameter_ends[0].y);
+            out += " to ";
+            append_point(out, geo.diameter_ends[1].x, geo.diameter_ends[1].y);
+            out += '\n';
+            break;
+        default:
+            out += "Minimum bounding rectangle area: ";
+            append_float(out, geo.min_rect_area);
+            out += ", corners";
+            for (const Point& c : geo.min_rect) {
+                out += ' ';
+                append_point(out, c.x, c.y);
+            }
+            out += '\n';
+            break;
+        }
+    });
+    if (!answered) out += "Need at least 3 points not all on one line.\n";
+}
+
+// Classify X,Y ...: one bit per point, 1 for inside or on the hull
+static void classify_points(Graph& graph, const CommandLine& cmd, std::string& out) {
+    std::vector<Point> points;
+    if (!parse_points(cmd.rest, points)) {
+        out += "Invalid usage. Example: Classify 1,2 3,4\n";
+        return;
+    }
+    std::vector<uint8_t> inside(points.size());
+    bool answered = graph_hull_query(graph, [&](const GraphSnapshot& snap) {
+        hull_classify(snap.geometry->fan, points.data(), points.size(), inside.data());
+    });
+    if (!answered) {
+        out += "Need at least 3 points not all on one line.\n";
+        return;
+    }
+    append_int(out, std::count(inside.begin(), inside.end(), 1));
+    out += " of ";
+    append_int(out, points.size());
+    out += " points inside: ";
+    for (uint8_t bit : inside) out += bit ? '1' : '0';
+    out += '\n';
+}
+
+// Union G1 G2 ...: hull area of the named graphs' points taken together
+static void union_hull(const CommandLine& cmd, std::string& out) {
+    std::vector<std::shared_ptr<Graph>> graphs;
+    std::string_view rest = cmd.rest, name;
+    while (next_token(rest, name)) {
+        std::shared_ptr<Graph> graph = find_graph(std::string(name));
+        if (!graph) {
+            out += "No graph named ";
+            out += name;
+            out += ".\n";
+            return;
+        }
+        graphs.push_back(graph);
+    }
+    if (graphs.empty()) {
+        out += "Invalid usage. Example: Union graph1 graph2\n";
+        return;
+    }
+    std::shared_ptr<const GraphUnion> result = graph_union(graphs);
+    if (result->point_count < 3) {
+        out += "Need at least 3 points to compute convex hull.\n";
+        return;
+    }
+    out += "Union convex hull area: ";
+    append_float(out, result->hull_area);
+    out += " (";
+    append_int(out, result->hull.size());
+    out += " vertices, ";
+    append_int(out, result->point_count);
+    out += " points)\n";
+}
+
+static Histogram command_histogram(CommandId id) {
+    switch (id) {
+    case CMD_NEWGRAPH: return HIST_CMD_NEWGRAPH;
+    case CMD_NEWPOINT:
+    case CMD_NEWPOINTS: return HIST_CMD_NEWPOINT;
+    case CMD_REMOVEPOINT:
+    case CMD_REMOVEPOINTS: return HIST_CMD_REMOVEPOINT;
+    case CMD_CH: return HIST_CMD_CH;
+    default: return HIST_CMD_OTHER;
+    }
+}
+
+void handle_command(ClientSession& session, std::string_view cmdline, std::string& out) {
+    CommandLine cmd;
+    parse_command(cmdline, cmd);
+    MetricsTimer timer(command_histogram(cmd.id));
+    AdmissionSlot slot(cmd.id != CMD_STATS); // STATS must work under overload
+    if (slot.rejected()) {
+        out += "BUSY Server overloaded, try again later.\n";
+        return;
+    }
+
+    if (!session.graph) session.graph = get_graph(DEFAULT_GRAPH);
+
+    if (read_only && (cmd.id == CMD_NEWGRAPH || cmd.id == CMD_NEWPOINT || cmd.id == CMD_REMOVEPOINT ||
+                      cmd.id == CMD_NEWPOINTS || cmd.id == CMD_REMOVEPOINTS || cmd.id == CMD_WINDOW)) {
+        out += "Read-only follower; send writes to the leader.\n";
+        return;
+    }
+
+    switch (cmd.id) {
+    case CMD_USE: {
+        if (cmd.argc < 1) {
+            out += "Invalid usage. Example: Use mygraph\n";
+            return;
+        }
+        session.graph = get_graph(std::string(cmd.args[0]));
+        session.points_to_read = 0;
+        out += "Using graph ";
+        out += cmd.args[0];
+        out += ".\n";
+        break;
+    }
+    case CMD_NEWGRAPH: {
+        // Newgraph N resets the current graph; Newgraph <name> N switches first
+        bool named = cmd.argc >= 2;
         int n;
-        if (!(iss >> n) || n < 1) {
-            response << "Invalid usage. Example: Newgraph 4\n";
-            return response.str();
-        }
-        points.clear();
-        ch_cond.notify_all();
-        response << "OK. Send " << n << " points (x,y per line):\n";
-        return response.str();
-    } else if (cmd == "CH") {
+        if (cmd.argc < 1 || !parse_count(cmd.args[named ? 1 : 0], n)) {
+            out += "Invalid usage. Example: Newgraph 4 or Newgraph mygraph 4\n";
+            return;
+        }
+        if (named) session.graph = get_graph(std::string(cmd.args[0]));
+        reset_graph(*session.graph);
+        session.points_to_read = n;
+        out += "OK. Send ";
+        append_int(out, n);
+        out += " points (x,y per line):\n";
+        break;
+    }
+    case CMD_CH:
         try {
-            if (points.size() < 3) {
-                response << "Need at least 3 points to compute convex hull.\n";
+            float area;
+            if (!graph_hull_area(*session.graph, area)) {
+                out += "Need at least 3 points to compute convex hull.\n";
             } else {
-                std::vector<Point> hull = convex_hull(points);
-                float area = convex_hull_area(hull);
-                response << "Convex hull area: " << area << "\n";
+                out += "Convex hull area: ";
+                append_float(out, area);
+                out += '\n';
             }
         } catch (const std::exception& ex) {
-            response << "Error: " << ex.what() << "\n";
-        }
-        return response.str();
-    } else if (cmd == "Newpoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
-            return response.str();
-        }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
-        } else {
-            points.push_back({x, y});
-            ch_cond.notify_all();
-            response << "Point (" << x << "," << y << ") added.\n";
-        }
-        return response.str();
-    } else if (cmd == "Removepoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
-            return response.str();
-        }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
-        } else {
-            auto it = std::find_if(points.begin(), points.end(),
-                [x, y](const Point& p) { return p.x == x && p.y == y; });
-            if (it != points.end()) {
-                points.erase(it);
-                ch_cond.notify_all();
-                response << "Point (" << x << "," << y << ") removed.\n";
+            out += "Error: ";
+            out += ex.what();
+            out += '\n';
+        }
+        break;
+    case CMD_NEWPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Newpoint 1,2\n";
+            return;
+        }
+        add_point(*session.graph, p);
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        out += " added.\n";
+        break;
+    }
+    case CMD_REMOVEPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Removepoint 1,2\n";
+            return;
+        }
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        out += remove_point(*session.graph, p) ? " removed.\n" : " not found.\n";
+        break;
+    }
+    case CMD_INSIDE:
+    case CMD_EXTREME:
+    case CMD_TANGENTS:
+    case CMD_PERIMETER:
+    case CMD_DIAMETER:
+    case CMD_MINRECT:
+        hull_query(*session.graph, cmd, out);
+        break;
+    case CMD_CLASSIFY:
+        classify_points(*session.graph, cmd, out);
+        break;
+    case CMD_UNION:
+        union_hull(cmd, out);
+        break;
+    case CMD_NEWPOINTS: {
+        // All or nothing: one malformed token rejects the whole line
+        std::vector<Point> points;
+        if (!parse_points(cmd.rest, points)) {
+            out += "Invalid usage. Example: Newpoints 1,2 3,4\n";
+            return;
+        }
+        size_t count = add_points(*session.graph, points);
+        append_int(out, points.size());
+        out += " points added. Graph has ";
+        append_int(out, count);
+        out += " points.\n";
+        break;
+    }
+    case CMD_REMOVEPOINTS: {
+        std::vector<Point> points;
+        if (!parse_points(cmd.rest, points)) {
+            out += "Invalid usage. Example: Removepoints 1,2 3,4\n";
+            return;
+        }
+        append_int(out, remove_points(*session.graph, points));
+        out += " of ";
+        append_int(out, points.size());
+        out += " points removed.\n";
+        break;
+    }
+    case CMD_WINDOW: {
+        // Window N, Window Ts, Window N Ts: keep only the newest N points
+        // and/or those younger than T seconds. Window off: keep everything.
+        int max_points = 0;
+        float max_seconds = 0.0f;
+        bool off = cmd.argc == 1 && cmd.args[0] == "off";
+        bool valid = off || cmd.argc >= 1;
+        for (int i = 0; i < cmd.argc && i < 2 && valid && !off; ++i) {
+            std::string_view arg = cmd.args[i];
+            if (arg.size() > 1 && arg.back() == 's') {
+                valid = max_seconds == 0.0f && parse_float(arg.substr(0, arg.size() - 1), max_seconds) &&
+                        max_seconds > 0.0f;
             } else {
-                response << "Point (" << x << "," << y << ") not found.\n";
+                valid = max_points == 0 && parse_count(arg, max_points);
             }
         }
-        return response.str();
-    } else {
-        response << "Unknown command.\n";
-        return response.str();
+        if (!valid) {
+            out += "Invalid usage. Example: Window 1000, Window 30s, Window 1000 30s or Window off\n";
+            return;
+        }
+        size_t count = set_window(*session.graph, max_points, max_seconds);
+        out += off ? "Window off. Graph has " : "Window set. Graph has ";
+        append_int(out, count);
+        out += " points.\n";
+        break;
+    }
+    case CMD_SUBSCRIBE: {
+        // Subscribe T [H]: push an event when the area reaches T, and again
+        // when it drops below T - H
+        float threshold, hysteresis = 0.0f;
+        if (cmd.argc < 1 || !parse_float(cmd.args[0], threshold) ||
+            (cmd.argc >= 2 && !parse_float(cmd.args[1], hysteresis)) || hysteresis < 0.0f) {
+            out += "Invalid usage. Example: Subscribe 100 or Subscribe 100 10\n";
+            return;
+        }
+        float area;
+        bool above = subscribe(*session.graph, session.conn, threshold, hysteresis, area);
+        out += "Subscribed to CH area ";
+        append_float(out, threshold);
+        out += " (hysteresis ";
+        append_float(out, hysteresis);
+        out += "). Area is ";
+        append_float(out, area);
+        out += above ? ", at or above.\n" : ", below.\n";
+        break;
+    }
+    case CMD_UNSUBSCRIBE:
+        out += "Removed ";
+        append_int(out, unsubscribe(session.conn.get()));
+        out += " subscriptions.\n";
+        break;
+    case CMD_STATS:
+        out += replication_report();
+        out += metrics_report();
+        break;
+    default:
+        metrics_add(CTR_UNKNOWN_COMMANDS);
+        out += "Unknown command.\n";
+        break;
     }
 }
 
 void* client_thread(int client_fd) {
     char buf[BUFSIZE];
     ssize_t nbytes;
-    std::string leftover;
+    std::string input; // Bytes received but not yet handled: a partial line
+    std::string out;   // Replies to one read; keeps its capacity across reads
+    ClientSession session;
+    session.graph = get_graph(DEFAULT_GRAPH);
+    session.conn = std::make_shared<Connection>(client_fd);
+    metrics_add(CTR_CONNECTIONS_ACCEPTED);
 
     std::string welcome = "Welcome to the Convex Hull Server!\n";
-    send(client_fd, welcome.c_str(), welcome.size(), 0);
-
-    while ((nbytes = recv(client_fd, buf, sizeof(buf) - 1, 0)) > 0) {
-        buf[nbytes] = '\0';
-        std::string input = leftover + std::string(buf);
-        size_t pos = 0;
-        std::string line;
-        std::ostringstream response;
-
-        while ((pos = input.find('\n')) != std::string::npos) {
-            line = input.substr(0, pos);
-            input.erase(0, pos + 1);
-            if (!line.empty() && line.back() == '\r') line.pop_back();
-            if (!line.empty()) {
-                bool handled = false;
-                {
-                    std::lock_guard<std::mutex> lock(points_mutex);
-                    if (points_to_read[client_fd] > 0) {
-                        // Parse as point
-                        std::replace(line.begin(), line.end(), ',', ' ');
-                        std::istringstream iss(line);
-                        float x, y;
-                        if (!(iss >> x >> y)) {
-                            response << "Invalid point format. Example: 1,2\n";
-                        } else {
-                            points.push_back({x, y});
-                            points_to_read[client_fd]--;
-                            ch_cond.notify_all();
-                            if (points_to_read[client_fd] == 0) {
-                                response << "Graph updated with " << points.size() << " points.\n";
-                            } else {
-                                response << "Point added. " << points_to_read[client_fd] << " more to go.\n";
-                            }
-                        }
-                        handled = true;
-                    }
+    send_reply(*session.conn, welcome);
+
+    while ((nbytes = recv(client_fd, buf, sizeof(buf), 0)) > 0) {
+        metrics_add(CTR_BYTES_IN, nbytes);
+        input.append(buf, nbytes);
+        std::string_view pending(input);
+        std::string_view line;
+        out.clear();
+
+        while (next_line(pending, line)) {
+            if (line.empty()) continue;
+            if (session.points_to_read > 0) {
+                // Parse as point
+                MetricsTimer timer(HIST_CMD_POINT);
+                Point p;
+                if (!parse_point(line, p)) {
+                    out += "Invalid point format. Example: 1,2\n";
+                    continue;
                 }
-                if (!handled) {
-                    std::istringstream iss(line);
-                    std::string cmd;
-                    iss >> cmd;
-                    if (cmd == "Newgraph") {
-                        int n;
-                        iss >> n;
-                        {
-                            std::lock_guard<std::mutex> lock(points_mutex);
-                            points_to_read[client_fd] = n;
-                        }
-                    }
-                    response << handle_command(line);
+                // Staged and committed together; replies go out only after
+                // the commit, so no client sees an ack before its point
+                session.staged.push_back(p);
+                session.points_to_read--;
+                if (session.points_to_read == 0) {
+                    out += "Graph updated with ";
+                    append_int(out, commit_staged(session));
+                    out += " points.\n";
+                } else {
+                    out += "Point added. ";
+                    append_int(out, session.points_to_read);
+                    out += " more to go.\n";
                 }
+            } else {
+                if (!session.staged.empty()) commit_staged(session);
+                handle_command(session, line, out);
             }
         }
-        leftover = input; 
+        input.erase(0, input.size() - pending.size());
+        if (!session.staged.empty()) commit_staged(session);
 
-        std::string resp = response.str();
-        if (!resp.empty()) {
-            send(client_fd, resp.c_str(), resp.size(), 0);
+        if (!out.empty()) {
+            send_reply(*session.conn, out);
         }
     }
+    unsubscribe(session.conn.get());
     {
-        std::lock_guard<std::mutex> lock(points_mutex);
-        points_to_read.erase(client_fd);
+        std::lock_guard<std::mutex> lock(session.conn->send_mutex);
+        session.conn->open = false;
+        close(client_fd);
     }
-    close(client_fd);
+    metrics_add(CTR_CONNECTIONS_CLOSED);
     std::cout << "Client thread exiting (fd=" << client_fd << ")\n";
     return nullptr;
 }
 
 void ch_monitor_thread() {
-    bool last_state = false;
+    std::map<Graph*, bool> last_state; // Per graph: was the area at least 100?
     while (true) {
-        std::unique_lock<std::mutex> lock(points_mutex);
-        ch_cond.wait(lock, []{ return true; }); // Wake up on notify
+        std::map<Graph*, std::chrono::steady_clock::time_point> changed;
+        {
+            std::unique_lock<std::mutex> lock(monitor_mutex);
+            monitor_cond.wait(lock, []{ return !changed_graphs.empty(); });
+            changed.swap(changed_graphs);
+        }
 
-        float area = 0.0f;
-        try {
-            if (points.size() >= 3) {
-                std::vector<Point> hull = convex_hull(points);
-                area = convex_hull_area(hull);
-            }
-        } catch (...) {}
+        for (auto& entry : changed) {
+            Graph* graph = entry.first;
+            float area = notify_subscribers(graph);
+            metrics_observe(HIST_MONITOR_LAG, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - entry.second).count());
 
-        bool now_at_least_100 = (area >= 100.0f);
-        if (now_at_least_100 && !last_state) {
-            std::cout << "At Least 100 units belongs to CH" << std::endl;
-        } else if (!now_at_least_100 && last_state) {
-            std::cout << "At Least 100 units no longer belongs to CH" << std::endl;
+            bool now_at_least_100 = (area >= 100.0f);
+            bool& was_at_least_100 = last_state[graph];
+            if (now_at_least_100 && !was_at_least_100) {
+                std::cout << "At Least 100 units belongs to CH" << graph_label(graph) << std::endl;
+            } else if (!now_at_least_100 && was_at_least_100) {
+                std::cout << "At Least 100 units no longer belongs to CH" << graph_label(graph) << std::endl;
+            }
+            was_at_least_100 = now_at_least_100;
         }
-        last_state = now_at_least_100;
     }
 }
 
-void run_server(int port) {
-    int listener;
-    struct sockaddr_in serveraddr;
+// Registry metrics plus per-graph sizes read from published snapshots, so a
+// scrape never takes a graph lock
+static std::string prometheus_body() {
+    std::ostringstream gauges;
+    gauges << "# TYPE ch_graph_points gauge\n";
+    std::ostringstream hulls;
+    hulls << "# TYPE ch_graph_hull_vertices gauge\n";
+    for_each_graph([&](Graph& graph) {
+        size_t points, hull_vertices;
+        graph_sizes(graph, points, hull_vertices);
+        std::string label = "{graph=" + metrics_label(graph.name) + "}";
+        gauges << "ch_graph_points" << label << " " << points << "\n";
+        hulls << "ch_graph_hull_vertices" << label << " " << hull_vertices << "\n";
+    });
+    return metrics_prometheus() + gauges.str() + hulls.str() + replication_prometheus();
+}
 
-    // Start the CH monitor thread
-    std::thread(ch_monitor_thread).detach();
+// One short HTTP/1.0 exchange per connection, on a thread of its own so
+// scrapes never wait behind clients
+static void metrics_listener_thread(int listener) {
+    while (true) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("accept (metrics)");
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+        // A scraper that never finishes its request must not wedge the endpoint
+        struct timeval timeout = {2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::string request;
+        char buf[BUFSIZE];
+        ssize_t n;
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8 * BUFSIZE &&
+               (n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            request.append(buf, n);
+        }
+        std::string reply = metrics_http_response(request, prometheus_body());
+        send_all(fd, reply.data(), reply.size(), 0);
+        close(fd);
+    }
+}
 
-    listener = socket(AF_INET, SOCK_STREAM, 0);
+static bool start_metrics_listener(int port) {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (listener < 0) {
-        perror("socket");
-        return;
+        perror("socket (metrics)");
+        return false;
     }
 
     int yes = 1;
     setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
 
-    memset(&serveraddr, 0, sizeof(serveraddr));
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_addr.s_addr = INADDR_ANY;
-    serveraddr.sin_port = htons(port);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
 
-    if (bind(listener, (struct sockaddr*)&serveraddr, sizeof(serveraddr)) < 0) {
-        perror("bind");
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 16) < 0) {
+        perror("metrics listener");
         close(listener);
+        return false;
+    }
+    std::thread(metrics_listener_thread, listener).detach();
+    std::cout << "Metrics on port " << port << " (/metrics)" << std::endl;
+    return true;
+}
+
+// Serves each "name=path" graph straight from its mapped file
+static bool attach_graph_files(const std::vector<std::string>& specs) {
+    for (const std::string& spec : specs) {
+        size_t eq = spec.find('=');
+        if (eq == 0 || eq == std::string::npos) {
+            std::cerr << "Graph file must be given as name=path: " << spec << std::endl;
+            return false;
+        }
+        std::string name = spec.substr(0, eq);
+        std::shared_ptr<const GraphFile> file = map_graph_file(spec.substr(eq + 1));
+        if (!file) return false;
+        std::shared_ptr<Graph> graph = get_graph(name);
+        GraphWriteBatch(*graph).attach(file);
+        std::cout << "Mapped graph " << name << ": " << file->point_count << " points" << std::endl;
+    }
+    return true;
+}
+
+void run_server(const ServerOptions& options) {
+    int listener = -1, unix_listener = -1;
+
+    if (options.port <= 0 && options.unix_path.empty()) {
+        std::cerr << "Nothing to listen on: give a TCP port or a Unix socket path" << std::endl;
         return;
     }
 
-    if (listen(listener, BACKLOG) < 0) {
-        perror("listen");
-        close(listener);
+    // Recover before anything can observe or mutate the graphs. Mapped files
+    // come first so the log replays on top of them.
+    if (!attach_graph_files(options.graph_files)) return;
+    if (!options.leader_address.empty() && (!options.wal_dir.empty() || !options.replication_address.empty())) {
+        std::cerr << "A follower takes its graphs from the leader; it cannot use -w or -r" << std::endl;
+        return;
+    }
+    if (!options.replication_address.empty() && options.wal_dir.empty()) {
+        std::cerr << "Replication ships the write-ahead log; -r needs -w" << std::endl;
         return;
     }
+    if (!options.wal_dir.empty() && !start_wal(options.wal_dir, options.wal_durability)) return;
+    if (!options.replication_address.empty() && !start_replication_leader(options.replication_address)) return;
 
-    std::cout << "Server started on port " << port << std::endl;
+    if (options.graph_actor) {
+        start_graph_actor();
+        actor_mode = true;
+    }
+    admission_configure(options.max_inflight, options.queue_target_ms);
 
-    // Use the proactor to handle clients
-    pthread_t proactor_tid = startProactor(listener, client_thread);
+    if (options.metrics_port > 0) start_metrics_listener(options.metrics_port);
 
-    // Wait for the proactor thread to finish (infinite loop)
-    pthread_join(proactor_tid, nullptr);
+    // Start the CH monitor thread
+    set_graph_change_hook(on_graph_changed);
+    std::thread(ch_monitor_thread).detach();
 
-    close(listener);
-}
\ No newline at end of file
+    // After the monitor hook, so it sees the graphs the leader sends
+    if (!options.leader_address.empty()) {
+        read_only = true;
+        start_replication_follower(options.leader_address);
+    }
+
+    if (options.port > 0 && (listener = open_tcp_listener(options.port, options.backlog, SOCK_CLOEXEC)) < 0) return;
+    if (!options.unix_path.empty() &&
+        (unix_listener = open_unix_listener(options.unix_path, options.backlog, SOCK_CLOEXEC)) < 0) {
+        if (listener >= 0) close(listener);
+        return;
+    }
+
+    const char* mode = actor_mode ? " (single-writer graph actor)" : "";
+    if (listener >= 0) std::cout << "Server started on port " << options.port << mode << std::endl;
+    if (unix_listener >= 0) std::cout << "Server started on Unix socket " << options.unix_path << mode << std::endl;
+
+    // One proactor per listener; they share the client thread count
+    pthread_t proactor_tid = 0, unix_proactor_tid = 0;
+    if (listener >= 0) proactor_tid = startProactor(listener, client_thread, options.max_connections, reject_client);
+    if (unix_listener >= 0) {
+        unix_proactor_tid = startProactor(unix_listener, client_thread, options.max_connections, reject_client);
+    }
+
+    // Wait for the proactor threads to finish (infinite loop)
+    if (listener >= 0) pthread_join(proactor_tid, nullptr);
+    if (unix_listener >= 0) pthread_join(unix_proactor_tid, nullptr);
+
+    if (unix_listener >= 0) close(unix_listener);
+    if (listener >= 0) close(listener);
+}
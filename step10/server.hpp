@@ -1,8 +1,58 @@
 #pragma once
+#include "admission.hpp"
+#include "graph_store.hpp"
+#include "wal.hpp"
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
+
+// Default listen() backlog; the kernel clamps it to net.core.somaxconn
+#define DEFAULT_BACKLOG 1024
+#define DEFAULT_MAX_CONNECTIONS 4096 // More are answered BUSY and closed
+#define DEFAULT_MAX_INFLIGHT 64 // Commands running at once; more wait for a slot
+
+struct ServerOptions {
+    int port = 9034;          // 0: no TCP listener
+    std::string unix_path;    // Also accept clients on this Unix socket ('@' first: abstract namespace)
+    int backlog = DEFAULT_BACKLOG;
+    bool graph_actor = false; // Apply all mutations on one owner thread
+    int max_connections = DEFAULT_MAX_CONNECTIONS; // 0: no cap
+    int max_inflight = DEFAULT_MAX_INFLIGHT;       // 0: no admission control
+    int queue_target_ms = DEFAULT_QUEUE_TARGET_MS; // Queueing delay that counts as overload
+    int metrics_port = 0;     // Serve Prometheus /metrics here; 0 disables it
+    std::string wal_dir;      // Persist graphs here; empty disables the WAL
+    WalDurability wal_durability = WAL_ASYNC;
+    std::vector<std::string> graph_files; // "name=path" graph files to map at startup
+    std::string replication_address; // Ship the WAL to followers here (port or socket path)
+    std::string leader_address;      // Follow this leader read-only (host:port or socket path)
+};
 
 // Start the convex hull server (blocking call)
-void run_server(int port = 9034);
+void run_server(const ServerOptions& options);
+
+// A client socket shared by its client thread (replies) and the CH monitor
+// (pushed subscription events). send_mutex keeps lines from interleaving
+// and guards open and stalled, so nothing is sent after the client thread
+// closes fd. It is never held while waiting for socket space.
+struct Connection {
+    explicit Connection(int fd) : fd(fd) {}
+    int fd;
+    std::mutex send_mutex;
+    bool open = true;
+    bool stalled = false; // A reply is part sent and waiting for socket space
+    std::string held_events; // Events that came while stalled, sent after the reply
+};
+
+// Per-connection state: the graph the client works on and how many
+// point lines are still expected after Newgraph
+struct ClientSession {
+    std::shared_ptr<Graph> graph;
+    int points_to_read = 0;
+    std::vector<Point> staged; // Point lines received but not yet committed
+    std::shared_ptr<Connection> conn; // Target of Subscribe events
+};
 
-// Handle a single command from a client and return the response
-std::string handle_command(const std::string& cmdline);
\ No newline at end of file
+// Handle a single command from a client, appending the response to out
+void handle_command(ClientSession& session, std::string_view cmdline, std::string& out);
\ No newline at end of file
@@ -1,6 +1,36 @@
 #include "server.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
 
-int main() {
-    run_server(9034);
+int main(int argc, char* argv[]) {
+    ServerOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:u:ac:i:t:m:w:d:f:r:l:")) != -1) {
+        switch (opt) {
+        case 'p': options.port = std::atoi(optarg); break;
+        case 'b': options.backlog = std::atoi(optarg); break;
+        case 'u': options.unix_path = optarg; break;
+        case 'a': options.graph_actor = true; break;
+        case 'c': options.max_connections = std::atoi(optarg); break;
+        case 'i': options.max_inflight = std::atoi(optarg); break;
+        case 't': options.queue_target_ms = std::atoi(optarg); break;
+        case 'm': options.metrics_port = std::atoi(optarg); break;
+        case 'w': options.wal_dir = optarg; break;
+        case 'f': options.graph_files.push_back(optarg); break;
+        case 'r': options.replication_address = optarg; break;
+        case 'l': options.leader_address = optarg; break;
+        case 'd':
+            if (!parse_wal_durability(optarg, options.wal_durability)) {
+                std::cerr << "Durability must be os, async or sync" << std::endl;
+                return 1;
+            }
+            break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-p port] [-u unix_path|@name] [-b backlog] [-a] [-c max_connections] [-i max_inflight] [-t queue_target_ms] [-m metrics_port] [-w wal_dir] [-d os|async|sync] [-f name=graph_file]... [-r replication_port|path] [-l leader_host:port|path]" << std::endl;
+            return 1;
+        }
+    }
+    run_server(options);
     return 0;
 }
\ No newline at end of file
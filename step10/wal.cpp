@@ -0,0 +1,466 @@
+#include "wal.hpp"
+#include "graph_store.hpp"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define WAL_SEGMENT_BYTES (64 << 20) // Rotate and snapshot once a segment reaches this size
+#define WAL_ASYNC_INTERVAL_MS 100
+#define WAL_RECORD_HEADER 24 // checksum u32, lsn u64, op u8, pad u8, name length u16, x, y
+#define SNAPSHOT_MAGIC "CHSNAP02"
+#define SNAPSHOT_MAGIC_V1 "CHSNAP01" // No window limits; still read
+
+static std::string wal_dir;
+static WalDurability durability;
+
+static std::mutex wal_mutex;
+static std::condition_variable flush_cond;   // Flusher waits for records
+static std::condition_variable durable_cond; // WAL_SYNC writers wait for their fsync
+static std::string pending;                  // Encoded records not yet written
+static uint64_t next_lsn = 1;
+static uint64_t pending_last_lsn = 0;
+static uint64_t durable_lsn = 0;
+static bool flusher_waiting = false;
+
+static std::mutex snapshot_mutex;
+static std::condition_variable snapshot_cond;
+static uint64_t snapshot_boundary = 0; // Segments before this LSN can go once a snapshot exists
+
+static int segment_fd = -1; // Flusher thread only after startup
+static size_t segment_bytes = 0;
+static std::atomic<WalShipper> shipper{nullptr};
+
+template <typename T>
+static void put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static T get(const char* p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+// FNV-1a over 8-byte words; enough to detect torn or garbled tails
+static uint64_t checksum(const char* data, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) h = (h ^ get<uint64_t>(data + i)) * 1099511628211ull;
+    for (; i < len; ++i) h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+    return h;
+}
+
+static std::string segment_path(uint64_t start_lsn) {
+    char name[32];
+    snprintf(name, sizeof(name), "wal.%020llu", static_cast<unsigned long long>(start_lsn));
+    return wal_dir + "/" + name;
+}
+
+// Fatal: acknowledging writes that may not be on disk is worse than stopping
+static void die(const char* what) {
+    perror(what);
+    exit(EXIT_FAILURE);
+}
+
+static bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_file(const std::string& path, std::string& out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    out.resize(st.st_size);
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = read(fd, &out[done], out.size() - done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        done += n;
+    }
+    out.resize(done);
+    close(fd);
+    return true;
+}
+
+static void sync_dir() {
+    int fd = open(wal_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static void open_segment(uint64_t start_lsn) {
+    segment_fd = open(segment_path(start_lsn).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (segment_fd < 0) die("open (wal segment)");
+    segment_bytes = 0;
+    sync_dir();
+}
+
+// Start LSNs of the segments on disk, oldest first
+static std::vector<uint64_t> list_segments() {
+    std::vector<uint64_t> starts;
+    DIR* dir = opendir(wal_dir.c_str());
+    if (!dir) return starts;
+    while (struct dirent* entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "wal.", 4) == 0) {
+            starts.push_back(strtoull(entry->d_name + 4, nullptr, 10));
+        }
+    }
+    closedir(dir);
+    std::sort(starts.begin(), starts.end());
+    return starts;
+}
+
+// Runs under the graph's lock, so records of one graph are in apply order
+static uint64_t wal_append(const Graph& graph, GraphMutation op, const Point& p) {
+    std::lock_guard<std::mutex> lock(wal_mutex);
+    uint64_t lsn = next_lsn++;
+    size_t start = pending.size();
+    put<uint32_t>(pending, 0);
+    put<uint64_t>(pending, lsn);
+    put<uint8_t>(pending, op);
+    put<uint8_t>(pending, 0);
+    put<uint16_t>(pending, graph.name.size());
+    put<float>(pending, p.x);
+    put<float>(pending, p.y);
+    pending.append(graph.name);
+    uint32_t sum = checksum(&pending[start + 4], pending.size() - start - 4);
+    memcpy(&pending[start], &sum, sizeof(sum));
+    pending_last_lsn = lsn;
+    if (flusher_waiting) flush_cond.notify_one();
+    return lsn;
+}
+
+static void wal_wait(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(wal_mutex);
+    durable_cond.wait(lock, [lsn]{ return durable_lsn >= lsn; });
+}
+
+static void request_snapshot(uint64_t boundary) {
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    snapshot_boundary = boundary;
+    snapshot_cond.notify_one();
+}
+
+static void flusher_thread() {
+    std::string batch;
+    while (true) {
+        uint64_t last;
+        if (durability == WAL_ASYNC) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(WAL_ASYNC_INTERVAL_MS));
+        }
+        {
+            std::unique_lock<std::mutex> lock(wal_mutex);
+            flusher_waiting = true;
+            flush_cond.wait(lock, []{ return !pending.empty(); });
+            flusher_waiting = false;
+            // Everything appended while the previous batch was syncing goes in one write
+            batch.swap(pending);
+            last = pending_last_lsn;
+        }
+        if (!write_all(segment_fd, batch.data(), batch.size())) die("write (wal)");
+        if (durability != WAL_OS && fdatasync(segment_fd) < 0) die("fdatasync (wal)");
+        segment_bytes += batch.size();
+        if (WalShipper ship = shipper.load()) ship(batch.data(), batch.size(), last);
+        batch.clear();
+        {
+            std::lock_guard<std::mutex> lock(wal_mutex);
+            durable_lsn = last;
+        }
+        durable_cond.notify_all();
+
+        if (segment_bytes >= WAL_SEGMENT_BYTES) {
+            // Later records go to the new segment, so a snapshot taken from
+            // now on covers everything in the older ones
+            if (fdatasync(segment_fd) < 0) die("fdatasync (wal)");
+            close(segment_fd);
+            open_segment(last + 1);
+            request_snapshot(last + 1);
+        }
+    }
+}
+
+// Each graph is copied under its own lock together with the LSN of its
+// last logged mutation, so replaying later records on top is exact.
+static std::string encode_snapshot(bool include_mapped) {
+    std::string out(SNAPSHOT_MAGIC);
+    put<uint32_t>(out, 0); // Graph count, patched below
+    uint32_t graphs = 0;
+    for_each_graph([&](Graph& graph) {
+        std::lock_guard<std::mutex> lock(graph.mutex);
+        // Unchanged mapped graphs are reloaded from their file on restart
+        if (graph.mapped && !include_mapped) return;
+        const Point* points = graph.mapped ? graph.mapped->points : graph.points.data();
+        uint64_t count = graph.mapped ? graph.mapped->point_count : graph.points.size();
+        std::vector<Point> window_points;
+        if (graph.window) {
+            graph.window->hull.points(window_points);
+            points = window_points.data();
+            count = window_points.size();
+        }
+        put<uint16_t>(out, graph.name.size());
+        out.append(graph.name);
+        put<uint64_t>(out, graph.journal_lsn);
+        put<uint32_t>(out, graph.window ? graph.window->max_points : 0);
+        put<double>(out, graph.window ? graph.window->max_seconds : 0.0);
+        put<uint64_t>(out, count);
+        out.append(reinterpret_cast<const char*>(points), count * sizeof(Point));
+        ++graphs;
+    });
+    memcpy(&out[strlen(SNAPSHOT_MAGIC)], &graphs, sizeof(graphs));
+    put<uint64_t>(out, checksum(out.data(), out.size()));
+    return out;
+}
+
+static bool write_snapshot() {
+    std::string out = encode_snapshot(false);
+
+    std::string tmp = wal_dir + "/snapshot.tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open (snapshot)");
+        return false;
+    }
+    bool ok = write_all(fd, out.data(), out.size()) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), (wal_dir + "/snapshot").c_str()) < 0) {
+        perror("snapshot");
+        return false;
+    }
+    sync_dir();
+    return true;
+}
+
+static void snapshot_thread() {
+    while (true) {
+        uint64_t boundary;
+        {
+            std::unique_lock<std::mutex> lock(snapshot_mutex);
+            snapshot_cond.wait(lock, []{ return snapshot_boundary != 0; });
+            boundary = snapshot_boundary;
+            snapshot_boundary = 0;
+        }
+        if (!write_snapshot()) continue; // Keep the segments; retried after the next rotation
+        std::vector<uint64_t> starts = list_segments();
+        for (uint64_t start : starts) {
+            if (start < boundary) unlink(segment_path(start).c_str());
+        }
+    }
+}
+
+// Bulk-loads every graph with its points and the LSN they include. With
+// exact, graphs the snapshot does not list are emptied.
+static bool apply_snapshot(const std::string& data, bool exact, size_t& graphs, size_t& points) {
+    size_t magic = strlen(SNAPSHOT_MAGIC);
+    bool v1 = data.compare(0, magic, SNAPSHOT_MAGIC_V1) == 0;
+    if (data.size() < magic + 4 + 8 || (!v1 && data.compare(0, magic, SNAPSHOT_MAGIC) != 0) ||
+        get<uint64_t>(&data[data.size() - 8]) != checksum(data.data(), data.size() - 8)) {
+        std::cerr << "wal: snapshot is corrupt" << std::endl;
+        return false;
+    }
+    const char* p = data.data() + magic;
+    uint32_t count = get<uint32_t>(p);
+    p += 4;
+    std::set<std::string> listed;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint16_t name_len = get<uint16_t>(p);
+        std::string name(p + 2, name_len);
+        p += 2 + name_len;
+        listed.insert(name);
+        uint64_t lsn = get<uint64_t>(p);
+        p += 8;
+        uint32_t window_points = 0;
+        double window_seconds = 0;
+        if (!v1) {
+            window_points = get<uint32_t>(p);
+            window_seconds = get<double>(p + 4);
+            p += 12;
+        }
+        uint64_t n = get<uint64_t>(p);
+        p += 8;
+        std::vector<Point> loaded(n);
+        memcpy(loaded.data(), p, n * sizeof(Point));
+        p += n * sizeof(Point);
+
+        std::shared_ptr<Graph> graph = get_graph(name);
+        GraphWriteBatch batch(*graph);
+        batch.replace_points(std::move(loaded), window_points, window_seconds);
+        graph->journal_lsn = lsn;
+        next_lsn = std::max(next_lsn, lsn + 1);
+        points += n;
+    }
+    graphs = count;
+
+    if (exact) {
+        std::vector<std::string> unlisted;
+        for_each_graph([&](Graph& graph) {
+            if (!listed.count(graph.name)) unlisted.push_back(graph.name);
+        });
+        for (const std::string& name : unlisted) {
+            std::shared_ptr<Graph> graph = get_graph(name);
+            GraphWriteBatch batch(*graph);
+            batch.replace_points(std::vector<Point>());
+            graph->journal_lsn = 0;
+        }
+    }
+    return true;
+}
+
+static bool load_snapshot(size_t& graphs, size_t& points) {
+    std::string data;
+    if (!read_file(wal_dir + "/snapshot", data)) return true; // First start
+    return apply_snapshot(data, false, graphs, points);
+}
+
+// Applies the complete records at the front of data that the graphs do not
+// already include; consecutive records of a graph share one write batch.
+// Returns the bytes consumed, which stop short of a torn or garbled record.
+static size_t apply_records(const char* data, size_t size, size_t& applied) {
+    std::unordered_map<std::string, std::shared_ptr<Graph>> graphs;
+    Graph* current = nullptr;
+    std::unique_ptr<GraphWriteBatch> batch;
+    size_t pos = 0;
+    while (pos + WAL_RECORD_HEADER <= size) {
+        const char* rec = data + pos;
+        uint16_t name_len = get<uint16_t>(rec + 14);
+        size_t len = WAL_RECORD_HEADER + name_len;
+        if (pos + len > size ||
+            get<uint32_t>(rec) != static_cast<uint32_t>(checksum(rec + 4, len - 4))) {
+            break;
+        }
+        pos += len;
+        uint64_t lsn = get<uint64_t>(rec + 4);
+        next_lsn = std::max(next_lsn, lsn + 1);
+
+        const char* name = rec + WAL_RECORD_HEADER;
+        Graph* graph = current;
+        if (!graph || graph->name.compare(0, std::string::npos, name, name_len) != 0) {
+            std::shared_ptr<Graph>& slot = graphs[std::string(name, name_len)];
+            if (!slot) slot = get_graph(std::string(name, name_len));
+            graph = slot.get();
+        }
+        if (lsn <= graph->journal_lsn) continue;
+        if (graph != current) {
+            batch.reset(); // Publish the previous graph's run before locking the next
+            batch.reset(new GraphWriteBatch(*graph));
+            current = graph;
+        }
+        Point p = {get<float>(rec + 16), get<float>(rec + 20)};
+        switch (rec[12]) {
+        case MUTATION_RESET: batch->reset(); break;
+        case MUTATION_ADD: batch->add_point(p); break;
+        case MUTATION_REMOVE: batch->remove_point(p); break;
+        case MUTATION_WINDOW: {
+            size_t max_points;
+            double max_seconds;
+            window_limits(p, max_points, max_seconds);
+            batch->set_window(max_points, max_seconds);
+            break;
+        }
+        }
+        graph->journal_lsn = lsn;
+        ++applied;
+    }
+    return pos;
+}
+
+// Replays one segment; a torn tail (crash mid-write) ends it
+static size_t replay_segment(uint64_t start) {
+    std::string data;
+    if (!read_file(segment_path(start), data)) return 0;
+    size_t applied = 0;
+    size_t pos = apply_records(data.data(), data.size(), applied);
+    if (pos < data.size()) {
+        std::cerr << "wal: torn record at offset " << pos << " of " << segment_path(start)
+                  << ", ignoring the rest" << std::endl;
+    }
+    return applied;
+}
+
+bool parse_wal_durability(const std::string& name, WalDurability& out) {
+    if (name == "os") out = WAL_OS;
+    else if (name == "async") out = WAL_ASYNC;
+    else if (name == "sync") out = WAL_SYNC;
+    else return false;
+    return true;
+}
+
+bool start_wal(const std::string& dir, WalDurability level) {
+    wal_dir = dir;
+    durability = level;
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        perror("mkdir (wal)");
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t graphs = 0, points = 0, records = 0;
+    if (!load_snapshot(graphs, points)) return false;
+    for (uint64_t segment : list_segments()) records += replay_segment(segment);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "Recovered " << graphs << " graphs (" << points << " points) from snapshot and "
+              << records << " log records in " << ms << " ms" << std::endl;
+
+    // Never append to a segment that may end in a torn record
+    open_segment(next_lsn);
+    set_graph_journal(wal_append, durability == WAL_SYNC ? wal_wait : nullptr);
+    std::thread(flusher_thread).detach();
+    std::thread(snapshot_thread).detach();
+    return true;
+}
+
+void set_wal_shipper(WalShipper ship) {
+    shipper.store(ship);
+}
+
+uint64_t wal_last_lsn() {
+    std::lock_guard<std::mutex> lock(wal_mutex);
+    return next_lsn - 1;
+}
+
+std::string wal_encode_snapshot() {
+    return encode_snapshot(true);
+}
+
+bool wal_apply_snapshot(const std::string& data, size_t& graphs, size_t& points) {
+    return apply_snapshot(data, true, graphs, points);
+}
+
+bool wal_apply_records(const char* data, size_t len, size_t& applied) {
+    return apply_records(data, len, applied) == len;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Write-ahead log and snapshots for the graph store.
+//
+// Every mutation is appended to the current log segment under its graph's
+// lock. A flusher thread writes batches of records and fsyncs them, so one
+// fsync covers every writer that arrived meanwhile (group commit). When a
+// segment grows past WAL_SEGMENT_BYTES the flusher starts a new one and a
+// compact snapshot of all graphs is written, after which older segments are
+// deleted. Startup loads the snapshot and replays the remaining segments.
+
+enum WalDurability {
+    WAL_OS,    // write() only: survives a server crash, not a power loss
+    WAL_ASYNC, // fsync every WAL_ASYNC_INTERVAL_MS; replies don't wait
+    WAL_SYNC   // replies wait until their mutation is fsynced
+};
+
+// Parses "os", "async" or "sync"
+bool parse_wal_durability(const std::string& name, WalDurability& durability);
+
+// Recovers the graphs stored in dir (created if missing), then journals
+// every mutation from here on. Call before serving clients.
+bool start_wal(const std::string& dir, WalDurability durability);
+
+// Log shipping, for replication. The shipper gets each batch of encoded
+// records once the flusher has written it (and fsynced it, unless WAL_OS),
+// on the flusher thread, so it must not block.
+typedef void (*WalShipper)(const char* records, size_t len, uint64_t last_lsn);
+void set_wal_shipper(WalShipper ship);
+uint64_t wal_last_lsn();
+
+// Every graph in snapshot format, mapped graphs included
+std::string wal_encode_snapshot();
+// Makes the local graphs equal to an encoded snapshot; graphs it does not
+// list are emptied
+bool wal_apply_snapshot(const std::string& data, size_t& graphs, size_t& points);
+// Applies shipped records, skipping those a graph already includes.
+// Returns false if data does not hold only whole, intact records.
+bool wal_apply_records(const char* data, size_t len, size_t& applied);
@@ -0,0 +1,64 @@
+#pragma once
+#include "convex_hull.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+// The lower hull of an insertion-ordered point set, kept in a std::set so
+// a point is placed in O(log h) and each vertex it hides is dropped in
+// O(log h). Every change can be logged so the newest insertion can be
+// undone exactly. The upper hull is the lower hull of the negated points.
+class HullChain {
+public:
+    // Returns whether p became a vertex; vertices it hid are appended to
+    // removed when that is non-null
+    bool insert(const Point& p, std::vector<Point>* removed);
+    // Reverts the newest insertion: erases p if it was inserted and puts
+    // back the n vertices it hid
+    void undo(const Point& p, bool inserted, const Point* removed, size_t n);
+    void clear() { vertices.clear(); }
+    const std::set<Point>& points() const { return vertices; }
+
+private:
+    std::set<Point> vertices;
+};
+
+// Hull of a FIFO window of points: push the newest, pop the oldest. Two
+// stacks make a queue. New points go on the back stack, whose chains only
+// grow. When the front runs dry, the back is replayed newest to oldest into
+// the front chains with an undo log, so popping the oldest point undoes the
+// last insertion there. Each point is inserted at most twice and undone at
+// most once, so push and pop are amortized O(log n).
+class WindowHull {
+public:
+    // Both return whether either stack's hull changed
+    bool push(const Point& p);
+    bool pop();
+
+    size_t size() const { return front.size() + back.size(); }
+    bool empty() const { return size() == 0; }
+    void clear();
+
+    // Vertices of the front and back hulls. The window's hull is the hull
+    // of these, so it costs O(h log h) rather than a pass over the window.
+    std::vector<Point> hull_candidates() const;
+
+    // Every point in the window, oldest first
+    void points(std::vector<Point>& out) const;
+
+private:
+    struct FrontEntry {
+        Point p;
+        bool in_lower, in_upper;
+        uint32_t lower_removed, upper_removed; // Entries at the end of front_removed
+    };
+
+    void refill_front();
+
+    std::vector<FrontEntry> front; // Oldest last
+    std::vector<Point> front_removed;
+    HullChain front_lower, front_upper;
+    std::vector<Point> back; // Oldest first
+    HullChain back_lower, back_upper;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// In-process metrics. Each thread updates its own block without atomic
+// read-modify-writes; readers sum all blocks, plus the totals left behind
+// by threads that have exited.
+
+enum Counter {
+    CTR_CONNECTIONS_ACCEPTED,
+    CTR_CONNECTIONS_CLOSED,
+    CTR_BYTES_IN,
+    CTR_BYTES_OUT,
+    CTR_UNKNOWN_COMMANDS,
+    CTR_HULL_REBUILD_WAITS, // Readers that took another reader's hull rebuild instead of their own
+    CTR_CONNECTIONS_SHED, // Turned away with BUSY at the connection cap
+    CTR_COMMANDS_SHED, // Answered BUSY after waiting too long for a command slot
+    CTR_ADMISSION_OVERLOADS, // Times the command queue delay stayed over target for an interval
+    CTR_COUNT
+};
+
+enum Histogram {
+    HIST_CMD_NEWGRAPH,
+    HIST_CMD_POINT, // Point lines that follow Newgraph
+    HIST_CMD_NEWPOINT,
+    HIST_CMD_REMOVEPOINT,
+    HIST_CMD_CH,
+    HIST_CMD_OTHER,
+    HIST_CONVEX_HULL,
+    HIST_LOCK_WAIT, // Only contended graph lock acquisitions
+    HIST_MONITOR_LAG, // Graph change until the CH monitor evaluated it
+    HIST_REPLICATION_LAG, // Leader shipped a log batch until this follower applied it
+    HIST_ADMISSION_WAIT, // Wait for a command slot, including shed commands
+    HIST_COUNT
+};
+
+// Bucket i counts observations of at most 2^i microseconds; the last one
+// catches everything slower.
+#define METRICS_BUCKETS 24
+
+struct MetricsSnapshot {
+    uint64_t counters[CTR_COUNT];
+    uint64_t buckets[HIST_COUNT][METRICS_BUCKETS];
+    uint64_t count[HIST_COUNT];
+    uint64_t sum_ns[HIST_COUNT];
+};
+
+void metrics_add(Counter counter, uint64_t n = 1);
+void metrics_observe(Histogram hist, uint64_t ns);
+
+// Sums every thread's block; safe to call from any thread
+void metrics_snapshot(MetricsSnapshot& snap);
+
+const char* metrics_counter_name(Counter counter);
+const char* metrics_histogram_name(Histogram hist);
+uint64_t metrics_bucket_bound_us(int bucket);
+
+// Text for the STATS command
+std::string metrics_report();
+
+// Prometheus text exposition of the registry; servers append their own gauges
+std::string metrics_prometheus();
+
+// Quotes a Prometheus label value
+std::string metrics_label(const std::string& value);
+
+// HTTP/1.0 reply to a scrape request: body for GET /metrics, 404 otherwise
+std::string metrics_http_response(const std::string& request, const std::string& body);
+
+// Records the lifetime of the scope into a histogram
+class MetricsTimer {
+public:
+    explicit MetricsTimer(Histogram hist) : hist(hist), start(std::chrono::steady_clock::now()) {}
+    ~MetricsTimer() {
+        metrics_observe(hist, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    MetricsTimer(const MetricsTimer&) = delete;
+    MetricsTimer& operator=(const MetricsTimer&) = delete;
+
+private:
+    Histogram hist;
+    std::chrono::steady_clock::time_point start;
+};
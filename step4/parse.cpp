@@ -0,0 +1,146 @@
+#include "parse.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+// Length picks the candidate, one character settles ties, then a full compare
+CommandId command_id(std::string_view name) {
+    CommandId id = CMD_UNKNOWN;
+    const char* expected = nullptr;
+    switch (name.size()) {
+    case 2: id = CMD_CH; expected = "CH"; break;
+    case 3: id = CMD_USE; expected = "Use"; break;
+    case 5:
+        if (name[0] == 'U') { id = CMD_UNION; expected = "Union"; }
+        else { id = CMD_STATS; expected = "STATS"; }
+        break;
+    case 6:
+        if (name[0] == 'W') { id = CMD_WINDOW; expected = "Window"; }
+        else { id = CMD_INSIDE; expected = "Inside"; }
+        break;
+    case 7:
+        if (name[0] == 'E') { id = CMD_EXTREME; expected = "Extreme"; }
+        else { id = CMD_MINRECT; expected = "MinRect"; }
+        break;
+    case 8:
+        if (name[0] == 'T') { id = CMD_TANGENTS; expected = "Tangents"; }
+        else if (name[0] == 'C') { id = CMD_CLASSIFY; expected = "Classify"; }
+        else if (name[0] == 'D') { id = CMD_DIAMETER; expected = "Diameter"; }
+        else if (name[3] == 'g') { id = CMD_NEWGRAPH; expected = "Newgraph"; }
+        else { id = CMD_NEWPOINT; expected = "Newpoint"; }
+        break;
+    case 9:
+        if (name[0] == 'N') { id = CMD_NEWPOINTS; expected = "Newpoints"; }
+        else if (name[0] == 'P') { id = CMD_PERIMETER; expected = "Perimeter"; }
+        else { id = CMD_SUBSCRIBE; expected = "Subscribe"; }
+        break;
+    case 11:
+        if (name[0] == 'R') { id = CMD_REMOVEPOINT; expected = "Removepoint"; }
+        else { id = CMD_UNSUBSCRIBE; expected = "Unsubscribe"; }
+        break;
+    case 12: id = CMD_REMOVEPOINTS; expected = "Removepoints"; break;
+    default: return CMD_UNKNOWN;
+    }
+    return memcmp(name.data(), expected, name.size()) == 0 ? id : CMD_UNKNOWN;
+}
+
+void parse_command(std::string_view line, CommandLine& cmd) {
+    cmd.name = std::string_view();
+    cmd.argc = 0;
+    cmd.rest = std::string_view();
+    const char* p = line.data();
+    const char* end = p + line.size();
+    bool first = true;
+    while (true) {
+        while (p != end && is_space(*p)) ++p;
+        if (p == end) break;
+        const char* start = p;
+        while (p != end && !is_space(*p)) ++p;
+        std::string_view token(start, p - start);
+        if (first) {
+            cmd.name = token;
+            first = false;
+        } else if (cmd.argc < MAX_COMMAND_ARGS) {
+            if (cmd.argc == 0) cmd.rest = std::string_view(start, end - start);
+            cmd.args[cmd.argc++] = token;
+        } else {
+            break;
+        }
+    }
+    cmd.id = command_id(cmd.name);
+}
+
+// Parses a number at [first, last); nullptr unless it is a finite float.
+// A leading '+' is accepted like the stream parser did.
+static const char* parse_float_prefix(const char* first, const char* last, float& value) {
+    if (first != last && *first == '+') ++first;
+    if (first == last || *first == '+') return nullptr;
+    if (*first != '-' && *first != '.' && (*first < '0' || *first > '9')) return nullptr; // No inf/nan
+    std::from_chars_result r = std::from_chars(first, last, value);
+    if (r.ec != std::errc() || !std::isfinite(value)) return nullptr;
+    return r.ptr;
+}
+
+bool parse_count(std::string_view token, int& n) {
+    const char* first = token.data();
+    const char* last = first + token.size();
+    if (first != last && *first == '+') ++first;
+    std::from_chars_result r = std::from_chars(first, last, n);
+    return r.ec == std::errc() && r.ptr == last && n >= 1;
+}
+
+bool parse_float(std::string_view token, float& value) {
+    const char* last = token.data() + token.size();
+    return parse_float_prefix(token.data(), last, value) == last;
+}
+
+bool parse_point(std::string_view text, Point& p) {
+    const char* pos = text.data();
+    const char* last = pos + text.size();
+    while (pos != last && is_space(*pos)) ++pos;
+    pos = parse_float_prefix(pos, last, p.x);
+    if (!pos) return false;
+    while (pos != last && (*pos == ',' || is_space(*pos))) ++pos;
+    return parse_float_prefix(pos, last, p.y) != nullptr;
+}
+
+bool parse_points(std::string_view text, std::vector<Point>& points) {
+    points.clear();
+    const char* pos = text.data();
+    const char* last = pos + text.size();
+    while (true) {
+        while (pos != last && is_space(*pos)) ++pos;
+        if (pos == last) break;
+        Point p;
+        pos = parse_float_prefix(pos, last, p.x);
+        if (!pos || pos == last || *pos != ',') return false;
+        pos = parse_float_prefix(pos + 1, last, p.y);
+        if (!pos || (pos != last && !is_space(*pos))) return false;
+        points.push_back(p);
+    }
+    return !points.empty();
+}
+
+bool next_token(std::string_view& text, std::string_view& token) {
+    size_t start = 0;
+    while (start < text.size() && is_space(text[start])) ++start;
+    size_t end = start;
+    while (end < text.size() && !is_space(text[end])) ++end;
+    token = text.substr(start, end - start);
+    text.remove_prefix(end);
+    return !token.empty();
+}
+
+bool next_line(std::string_view& input, std::string_view& line) {
+    const void* nl = memchr(input.data(), '\n', input.size());
+    if (!nl) return false;
+    size_t len = static_cast<const char*>(nl) - input.data();
+    line = input.substr(0, len);
+    input.remove_prefix(len + 1);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return true;
+}
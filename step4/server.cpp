@@ -1,5 +1,9 @@
 #include "server.hpp"
 #include "convex_hull.hpp"
+#include "metrics.hpp"
+#include "format.hpp"
+#include "parse.hpp"
+#include "listener.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -7,150 +11,332 @@
 #include <cstring>
 #include <vector>
 #include <string>
-#include <sstream>
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
 
-#define BACKLOG 10
 #define BUFSIZE 1024
+#define ACCEPT_BATCH 64 // Max accepts per readiness event, so a storm can't starve reads
+#define TURN_LINES 32 // Lines handled per connection per loop turn, so bulk senders take turns
 
 static std::vector<Point> points;
 static std::map<int, int> points_to_read; 
+static std::map<int, std::string> pending; // Input read but not yet handled, by fd
+static std::string reply; // Replies to one read, sent together
+static int reserve_fd = -1; // Spare descriptor released to shed connections on EMFILE
 
-std::string handle_command(const std::string& cmdline) {
-    std::istringstream iss(cmdline);
-    std::string cmd;
-    iss >> cmd;
-    std::ostringstream response;
+// accept4() that survives descriptor exhaustion: on EMFILE/ENFILE the reserve
+// fd is released so the pending connection can be accepted and closed at once,
+// instead of leaving the listener readable forever. Returns -1 with errno set
+// when nothing was handed out (EAGAIN once the backlog is drained).
+static int accept_client(int listener, int flags) {
+    while (true) {
+        int fd = accept4(listener, nullptr, nullptr, flags);
+        if (fd >= 0) return fd;
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        if ((errno == EMFILE || errno == ENFILE) && reserve_fd >= 0) {
+            close(reserve_fd);
+            int shed = accept(listener, nullptr, nullptr);
+            if (shed >= 0) close(shed);
+            reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            std::cerr << "accept: out of file descriptors, connection shed\n";
+            errno = EMFILE;
+        }
+        return -1;
+    }
+}
 
-    if (cmd == "Newgraph") {
+// Client sockets are non-blocking; wait for buffer space instead of dropping data.
+static void send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n > 0) {
+            metrics_add(CTR_BYTES_OUT, n);
+            data += n;
+            len -= n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, -1);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return;
+        }
+    }
+}
+
+// Drops one stored point per listed point in a single pass; returns how
+// many were found
+static size_t remove_many(std::vector<Point>& targets) {
+    std::sort(targets.begin(), targets.end());
+    std::vector<bool> taken(targets.size(), false);
+    size_t removed = 0;
+    auto keep = points.begin();
+    for (auto it = points.begin(); it != points.end(); ++it) {
+        size_t i = std::lower_bound(targets.begin(), targets.end(), *it) - targets.begin();
+        while (i < targets.size() && !(*it < targets[i]) && taken[i]) ++i;
+        if (i < targets.size() && !(*it < targets[i])) {
+            taken[i] = true;
+            ++removed;
+            continue;
+        }
+        *keep++ = *it;
+    }
+    points.erase(keep, points.end());
+    return removed;
+}
+
+static Histogram command_histogram(CommandId id) {
+    switch (id) {
+    case CMD_NEWGRAPH: return HIST_CMD_NEWGRAPH;
+    case CMD_NEWPOINT:
+    case CMD_NEWPOINTS: return HIST_CMD_NEWPOINT;
+    case CMD_REMOVEPOINT:
+    case CMD_REMOVEPOINTS: return HIST_CMD_REMOVEPOINT;
+    case CMD_CH: return HIST_CMD_CH;
+    default: return HIST_CMD_OTHER;
+    }
+}
+
+static void run_command(const CommandLine& cmd, std::string& out) {
+    MetricsTimer timer(command_histogram(cmd.id));
+
+    switch (cmd.id) {
+    case CMD_NEWGRAPH: {
         int n;
-        if (!(iss >> n) || n < 1) {
-            response << "Invalid usage. Example: Newgraph 4\n";
-            return response.str();
+        if (cmd.argc < 1 || !parse_count(cmd.args[0], n)) {
+            out += "Invalid usage. Example: Newgraph 4\n";
+            return;
         }
         points.clear();
-        response << "OK. Send " << n << " points (x,y per line):\n";
-        return response.str();
-    }else if (cmd == "CH") {
+        out += "OK. Send ";
+        append_int(out, n);
+        out += " points (x,y per line):\n";
+        break;
+    }
+    case CMD_CH:
         try {
             if (points.size() < 3) {
-                response << "Need at least 3 points to compute convex hull.\n";
+                out += "Need at least 3 points to compute convex hull.\n";
             } else {
-                std::vector<Point> hull = convex_hull(points);
+                std::vector<Point> hull;
+                {
+                    MetricsTimer hull_timer(HIST_CONVEX_HULL);
+                    hull = convex_hull(points);
+                }
                 float area = convex_hull_area(hull);
-                response << "Convex hull area: " << area << "\n";
+                out += "Convex hull area: ";
+                append_float(out, area);
+                out += '\n';
             }
         } catch (const std::exception& ex) {
-            response << "Error: " << ex.what() << "\n";
+            out += "Error: ";
+            out += ex.what();
+            out += '\n';
+        }
+        break;
+    case CMD_NEWPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Newpoint 1,2\n";
+            return;
         }
-        return response.str();
-    } else if (cmd == "Newpoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
-            return response.str();
+        points.push_back(p);
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        out += " added.\n";
+        break;
+    }
+    case CMD_REMOVEPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Removepoint 1,2\n";
+            return;
         }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
+        auto it = std::find_if(points.begin(), points.end(),
+            [&p](const Point& q) { return q.x == p.x && q.y == p.y; });
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        if (it != points.end()) {
+            points.erase(it);
+            out += " removed.\n";
         } else {
-            points.push_back({x, y});
-            response << "Point (" << x << "," << y << ") added.\n";
+            out += " not found.\n";
         }
-        return response.str();
-    } else if (cmd == "Removepoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
-            return response.str();
+        break;
+    }
+    case CMD_NEWPOINTS: {
+        std::vector<Point> batch;
+        if (!parse_points(cmd.rest, batch)) {
+            out += "Invalid usage. Example: Newpoints 1,2 3,4\n";
+            return;
         }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
-        } else {
-            auto it = std::find_if(points.begin(), points.end(),
-                [x, y](const Point& p) { return p.x == x && p.y == y; });
-            if (it != points.end()) {
-                points.erase(it);
-                response << "Point (" << x << "," << y << ") removed.\n";
+        points.insert(points.end(), batch.begin(), batch.end());
+        append_int(out, batch.size());
+        out += " points added. Graph has ";
+        append_int(out, points.size());
+        out += " points.\n";
+        break;
+    }
+    case CMD_REMOVEPOINTS: {
+        std::vector<Point> batch;
+        if (!parse_points(cmd.rest, batch)) {
+            out += "Invalid usage. Example: Removepoints 1,2 3,4\n";
+            return;
+        }
+        size_t n = batch.size();
+        append_int(out, remove_many(batch));
+        out += " of ";
+        append_int(out, n);
+        out += " points removed.\n";
+        break;
+    }
+    case CMD_STATS:
+        out += metrics_report();
+        break;
+    default:
+        metrics_add(CTR_UNKNOWN_COMMANDS);
+        out += "Unknown command.\n";
+        break;
+    }
+}
+
+void handle_command(std::string_view cmdline, std::string& out) {
+    CommandLine cmd;
+    parse_command(cmdline, cmd);
+    run_command(cmd, out);
+}
+
+// Handles up to TURN_LINES lines of input and sends their replies; the
+// rest is left in input for the connection's next turn
+static void serve_lines(int fd, std::string_view& input) {
+    reply.clear(); // Keeps its capacity across reads
+    int budget = TURN_LINES;
+    while (!input.empty() && budget-- > 0) {
+        // Each read is taken as whole lines, the last one possibly unterminated
+        size_t nl = input.find('\n');
+        std::string_view line = input.substr(0, nl);
+        input.remove_prefix(nl == std::string_view::npos ? input.size() : nl + 1);
+        if (line.empty()) continue;
+
+        if (points_to_read.count(fd) && points_to_read[fd] > 0) {
+            MetricsTimer timer(HIST_CMD_POINT);
+            Point p;
+            if (!parse_point(line, p)) {
+                reply += "Invalid point format. Example: 1,2\n";
             } else {
-                response << "Point (" << x << "," << y << ") not found.\n";
+                points.push_back(p);
+                points_to_read[fd]--;
+                if (points_to_read[fd] == 0) {
+                    reply += "Graph updated with ";
+                    append_int(reply, points.size());
+                    reply += " points.\n";
+                    points_to_read.erase(fd);
+                } else {
+                    reply += "Point added. ";
+                    append_int(reply, points_to_read[fd]);
+                    reply += " more to go.\n";
+                }
             }
+            continue;
         }
-        return response.str();
-    } else {
-        response << "Unknown command.\n";
-        return response.str();
+
+        CommandLine cmd;
+        parse_command(line, cmd);
+        if (cmd.id == CMD_NEWGRAPH) {
+            MetricsTimer timer(HIST_CMD_NEWGRAPH);
+            int n;
+            if (cmd.argc < 1 || !parse_count(cmd.args[0], n)) {
+                reply += "Invalid usage. Example: Newgraph 4\n";
+                continue;
+            }
+            points.clear();
+            points_to_read[fd] = n;
+            reply += "OK. Send ";
+            append_int(reply, n);
+            reply += " points (x,y per line):\n";
+            continue;
+        }
+
+        run_command(cmd, reply);
     }
+    send_all(fd, reply.data(), reply.size());
 }
 
-void run_server(int port) {
-    int listener, newfd;
-    struct sockaddr_in serveraddr, clientaddr;
-    socklen_t addrlen;
+void run_server(int port, int backlog, const std::string& unix_path) {
+    int listener = -1, unix_listener = -1, newfd;
     char buf[BUFSIZE];
     fd_set master, read_fds;
-    int fdmax;
+    int fdmax = -1;
 
-    listener = socket(AF_INET, SOCK_STREAM, 0);
-    if (listener < 0) {
-        perror("socket");
+    if (port <= 0 && unix_path.empty()) {
+        std::cerr << "Nothing to listen on: give a TCP port or a Unix socket path" << std::endl;
         return;
     }
-
-    int yes = 1;
-    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
-
-    memset(&serveraddr, 0, sizeof(serveraddr));
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_addr.s_addr = INADDR_ANY;
-    serveraddr.sin_port = htons(port);
-
-    if (bind(listener, (struct sockaddr*)&serveraddr, sizeof(serveraddr)) < 0) {
-        perror("bind");
-        return;
-    }
-
-    if (listen(listener, BACKLOG) < 0) {
-        perror("listen");
+    if (port > 0 && (listener = open_tcp_listener(port, backlog, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) return;
+    if (!unix_path.empty() &&
+        (unix_listener = open_unix_listener(unix_path, backlog, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+        if (listener >= 0) close(listener);
         return;
     }
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
 
     FD_ZERO(&master);
-    FD_SET(listener, &master);
-    fdmax = listener;
+    for (int fd : {listener, unix_listener}) {
+        if (fd < 0) continue;
+        FD_SET(fd, &master);
+        fdmax = std::max(fdmax, fd);
+    }
 
-    std::cout << "Server started on port " << port << std::endl;
+    if (listener >= 0) std::cout << "Server started on port " << port << std::endl;
+    if (unix_listener >= 0) std::cout << "Server started on Unix socket " << unix_path << std::endl;
 
     while (true) {
         read_fds = master;
-        if (select(fdmax + 1, &read_fds, nullptr, nullptr, nullptr) == -1) {
+        // Connections with input left over only poll, so they get their turn
+        struct timeval no_wait = {0, 0};
+        if (select(fdmax + 1, &read_fds, nullptr, nullptr, pending.empty() ? nullptr : &no_wait) == -1) {
             perror("select");
             return;
         }
 
         for (int i = 0; i <= fdmax; ++i) {
-            if (FD_ISSET(i, &read_fds)) {
-                if (i == listener) {
-                    // New connection
-                    addrlen = sizeof(clientaddr);
-                    newfd = accept(listener, (struct sockaddr*)&clientaddr, &addrlen);
-                    if (newfd == -1) {
-                        perror("accept");
-                    } else {
+            bool queued = !pending.empty() && pending.count(i);
+            if (FD_ISSET(i, &read_fds) || queued) {
+                if (i == listener || i == unix_listener) {
+                    // Drain pending connections in batches, not just one per select()
+                    int accepted = 0;
+                    while (accepted++ < ACCEPT_BATCH &&
+                           (newfd = accept_client(i, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                        if (newfd >= FD_SETSIZE) {
+                            std::cerr << "accept: fd " << newfd << " exceeds FD_SETSIZE, closing\n";
+                            close(newfd);
+                            continue;
+                        }
                         FD_SET(newfd, &master);
+                        metrics_add(CTR_CONNECTIONS_ACCEPTED);
                         if (newfd > fdmax) fdmax = newfd;
                         std::string welcome = "Welcome to the Convex Hull Server!\n";
-                        send(newfd, welcome.c_str(), welcome.size(), 0);
+                        send_all(newfd, welcome.c_str(), welcome.size());
                     }
+                    if (newfd == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EMFILE && errno != ENFILE) {
+                        perror("accept");
+                    }
+                } else if (queued) {
+                    // Not read again until the last read is handled
+                    std::string& rest = pending[i];
+                    std::string_view input = rest;
+                    serve_lines(i, input);
+                    if (input.empty()) pending.erase(i);
+                    else rest.erase(0, rest.size() - input.size());
                 } else {
-                    int nbytes = recv(i, buf, sizeof(buf) - 1, 0);
+                    int nbytes = recv(i, buf, sizeof(buf), 0);
+                    if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        continue;
+                    }
                     if (nbytes <= 0) {
                         if (nbytes == 0) {
                             std::cout << "Socket " << i << " hung up\n";
@@ -159,60 +345,13 @@ void run_server(int port) {
                         }
                         close(i);
                         FD_CLR(i, &master);
+                        metrics_add(CTR_CONNECTIONS_CLOSED);
                         points_to_read.erase(i);
                     } else {
-                        buf[nbytes] = '\0';
-                        std::istringstream iss(buf);
-                        std::string line;
-                        std::ostringstream response;
-                        while (std::getline(iss, line)) {
-                            if (line.empty()) continue;
-
-                            if (points_to_read.count(i) && points_to_read[i] > 0) {
-                                std::replace(line.begin(), line.end(), ',', ' ');
-                                std::istringstream point_iss(line);
-                                float x, y;
-                                std::ostringstream point_response;
-                                if (!(point_iss >> x >> y)) {
-                                    point_response << "Invalid point format. Example: 1,2\n";
-                                } else {
-                                    points.push_back({x, y});
-                                    points_to_read[i]--;
-                                    if (points_to_read[i] == 0) {
-                                        point_response << "Graph updated with " << points.size() << " points.\n";
-                                        points_to_read.erase(i);
-                                    } else {
-                                        point_response << "Point added. " << points_to_read[i] << " more to go.\n";
-                                    }
-                                }
-                                response << point_response.str();
-                                continue;
-                            }
-
-                            if (line.find("Newgraph") == 0) {
-                                std::istringstream liss(line);
-                                std::string cmd, n_str;
-                                liss >> cmd;
-                                if (!(liss >> n_str)) {
-                                    response << "Invalid usage. Example: Newgraph 4\n";
-                                    continue;
-                                }
-                                int n;
-                                std::istringstream n_iss(n_str);
-                                if (!(n_iss >> n) || n < 1) {
-                                    response << "Invalid usage. Example: Newgraph 4\n";
-                                    continue;
-                                }
-                                points.clear();
-                                points_to_read[i] = n;
-                                response << "OK. Send " << n << " points (x,y per line):\n";
-                                continue;
-                            }
-
-                            response << handle_command(line);
-                        }
-                        std::string resp = response.str();
-                        send(i, resp.c_str(), resp.size(), 0);
+                        metrics_add(CTR_BYTES_IN, nbytes);
+                        std::string_view input(buf, nbytes);
+                        serve_lines(i, input);
+                        if (!input.empty()) pending[i].assign(input);
                     }
                 }
             }
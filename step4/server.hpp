@@ -1,8 +1,14 @@
 #pragma once
 #include <string>
+#include <string_view>
 
-// Start the convex hull server (blocking call)
-void run_server(int port = 9034);
+// Default listen() backlog; the kernel clamps it to net.core.somaxconn
+#define DEFAULT_BACKLOG 1024
 
-// Handle a single command from a client and return the response
-std::string handle_command(const std::string& cmdline);
\ No newline at end of file
+// Start the convex hull server (blocking call). It listens on TCP unless port
+// is 0 and on the Unix socket unix_path, '@' first for the abstract namespace,
+// unless that is empty.
+void run_server(int port = 9034, int backlog = DEFAULT_BACKLOG, const std::string& unix_path = "");
+
+// Handle a single command from a client, appending the response to out
+void handle_command(std::string_view cmdline, std::string& out);
\ No newline at end of file
@@ -1,6 +1,23 @@
 #include "server.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
 
-int main() {
-    run_server(9034);
+int main(int argc, char* argv[]) {
+    int port = 9034;
+    int backlog = DEFAULT_BACKLOG;
+    std::string unix_path;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:u:")) != -1) {
+        switch (opt) {
+        case 'p': port = std::atoi(optarg); break;
+        case 'b': backlog = std::atoi(optarg); break;
+        case 'u': unix_path = optarg; break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-p port] [-b backlog] [-u unix_path|@name]" << std::endl;
+            return 1;
+        }
+    }
+    run_server(port, backlog, unix_path);
     return 0;
 }
\ No newline at end of file
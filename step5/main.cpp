@@ -31,7 +31,7 @@ void on_new_connection(int listener_fd) {
     int client_fd = accept(listener_fd, (sockaddr*)&client_addr, &addrlen);
     if (client_fd >= 0) {
         std::cout << "New client: fd=" << client_fd << std::endl;
-        addFdToReactor(global_reactor, client_fd, on_client);
+        if (addFdToReactor(global_reactor, client_fd, on_client) < 0) close(client_fd); // Past FD_SETSIZE
     }
 }
 
@@ -1,38 +1,195 @@
 #include "reactor.hpp"
-#include <map>
-#include <set>
+#include <vector>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
 #include <sys/select.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
+// A registration: either a plain callback or one with a context pointer
+struct Handler {
+    reactorFunc plain = nullptr;
+    reactorCtxFunc func = nullptr;
+    void* ctx = nullptr;
+    unsigned long added_round = 0; // Loop round it was registered in
+
+    bool active() const { return plain || func; }
+    void call(int fd) const {
+        if (plain) plain(fd);
+        else func(fd, ctx);
+    }
+};
+
+struct FdSlot {
+    Handler read;
+    Handler write;
+    bool timer = false;
+};
+
 struct Reactor {
-    std::map<int, reactorFunc> fd_to_func;
-    std::set<int> fds;
-    bool running = false;
+    std::vector<FdSlot> slots; // Indexed by fd, so dispatch is a direct lookup
+    int max_fd = -1;           // No registrations above this
+    unsigned long round = 1;   // Bumped before each select
+    int wake_fd = -1; // Lets stopReactor() interrupt a blocking select
+    std::atomic<bool> running{false};
 };
 
 void* startReactor() {
     Reactor* reactor = new Reactor();
     reactor->running = false; // Only run when runReactor() is called
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wake_fd >= FD_SETSIZE) { // Not watchable; stopReactor then waits for the next event
+        close(reactor->wake_fd);
+        reactor->wake_fd = -1;
+    }
     return reactor;
 }
 
-int addFdToReactor(void* reactor_ptr, int fd, reactorFunc func) {
-    Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
-    reactor->fds.insert(fd);
-    reactor->fd_to_func[fd] = func;
+static FdSlot* slot_for(Reactor* reactor, int fd) {
+    if (fd < 0 || fd >= FD_SETSIZE) return nullptr; // FD_SET would write past the fd_set
+    if (static_cast<size_t>(fd) >= reactor->slots.size()) reactor->slots.resize(fd + 1);
+    if (fd > reactor->max_fd) reactor->max_fd = fd;
+    return &reactor->slots[fd];
+}
+
+static int set_handler(Reactor* reactor, int fd, Handler FdSlot::*which, const Handler& handler) {
+    FdSlot* slot = slot_for(reactor, fd);
+    if (!slot) return -1;
+    slot->*which = handler;
+    (slot->*which).added_round = reactor->round;
+    return 0;
+}
+
+static int clear_handler(Reactor* reactor, int fd, Handler FdSlot::*which) {
+    if (fd < 0 || static_cast<size_t>(fd) >= reactor->slots.size()) return 0;
+    reactor->slots[fd].*which = Handler();
+    while (reactor->max_fd >= 0) {
+        const FdSlot& top = reactor->slots[reactor->max_fd];
+        if (top.read.active() || top.write.active()) break;
+        --reactor->max_fd;
+    }
     return 0;
 }
 
+int addFdToReactor(void* reactor_ptr, int fd, reactorFunc func) {
+    Handler handler;
+    handler.plain = func;
+    return set_handler(static_cast<Reactor*>(reactor_ptr), fd, &FdSlot::read, handler);
+}
+
+int addFdToReactorCtx(void* reactor_ptr, int fd, reactorCtxFunc func, void* ctx) {
+    Handler handler;
+    handler.func = func;
+    handler.ctx = ctx;
+    return set_handler(static_cast<Reactor*>(reactor_ptr), fd, &FdSlot::read, handler);
+}
+
 int removeFdFromReactor(void* reactor_ptr, int fd) {
+    return clear_handler(static_cast<Reactor*>(reactor_ptr), fd, &FdSlot::read);
+}
+
+int addWriteFdToReactor(void* reactor_ptr, int fd, reactorFunc func) {
+    Handler handler;
+    handler.plain = func;
+    return set_handler(static_cast<Reactor*>(reactor_ptr), fd, &FdSlot::write, handler);
+}
+
+int addWriteFdToReactorCtx(void* reactor_ptr, int fd, reactorCtxFunc func, void* ctx) {
+    Handler handler;
+    handler.func = func;
+    handler.ctx = ctx;
+    return set_handler(static_cast<Reactor*>(reactor_ptr), fd, &FdSlot::write, handler);
+}
+
+int removeWriteFdFromReactor(void* reactor_ptr, int fd) {
+    return clear_handler(static_cast<Reactor*>(reactor_ptr), fd, &FdSlot::write);
+}
+
+void* getReactorFdContext(void* reactor_ptr, int fd) {
     Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
-    reactor->fds.erase(fd);
-    reactor->fd_to_func.erase(fd);
-    return 0;
+    if (fd < 0 || static_cast<size_t>(fd) >= reactor->slots.size()) return nullptr;
+    return reactor->slots[fd].read.ctx;
 }
 
 int stopReactor(void* reactor_ptr) {
     Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
     reactor->running = false;
+    uint64_t one = 1;
+    if (reactor->wake_fd >= 0 && write(reactor->wake_fd, &one, sizeof(one)) < 0) {
+        // Counter already pending; the loop will wake up anyway
+    }
+    return 0;
+}
+
+static void fill_timer_spec(struct itimerspec& spec, unsigned int initial_ms, unsigned int interval_ms) {
+    if (initial_ms == 0) initial_ms = 1; // A zero it_value would disarm the timer
+    spec.it_value.tv_sec = initial_ms / 1000;
+    spec.it_value.tv_nsec = (initial_ms % 1000) * 1000000L;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+}
+
+static int create_timer(unsigned int initial_ms, unsigned int interval_ms) {
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) {
+        perror("timerfd_create");
+        return -1;
+    }
+    struct itimerspec spec;
+    fill_timer_spec(spec, initial_ms, interval_ms);
+    if (timerfd_settime(tfd, 0, &spec, nullptr) < 0) {
+        perror("timerfd_settime");
+        close(tfd);
+        return -1;
+    }
+    return tfd;
+}
+
+int addTimerToReactor(void* reactor_ptr, unsigned int initial_ms, unsigned int interval_ms, reactorFunc func) {
+    Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
+    int tfd = create_timer(initial_ms, interval_ms);
+    if (tfd < 0) return -1;
+    if (addFdToReactor(reactor, tfd, func) < 0) {
+        close(tfd);
+        return -1;
+    }
+    reactor->slots[tfd].timer = true;
+    return tfd;
+}
+
+int addTimerToReactorCtx(void* reactor_ptr, unsigned int initial_ms, unsigned int interval_ms, reactorCtxFunc func, void* ctx) {
+    Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
+    int tfd = create_timer(initial_ms, interval_ms);
+    if (tfd < 0) return -1;
+    if (addFdToReactorCtx(reactor, tfd, func, ctx) < 0) {
+        close(tfd);
+        return -1;
+    }
+    reactor->slots[tfd].timer = true;
+    return tfd;
+}
+
+static bool is_timer(Reactor* reactor, int fd) {
+    return fd >= 0 && static_cast<size_t>(fd) < reactor->slots.size() && reactor->slots[fd].timer;
+}
+
+int rearmTimerInReactor(void* reactor_ptr, int timer_id, unsigned int initial_ms, unsigned int interval_ms) {
+    Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
+    if (!is_timer(reactor, timer_id)) return -1;
+    struct itimerspec spec;
+    fill_timer_spec(spec, initial_ms, interval_ms);
+    return timerfd_settime(timer_id, 0, &spec, nullptr);
+}
+
+int removeTimerFromReactor(void* reactor_ptr, int timer_id) {
+    Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
+    if (!is_timer(reactor, timer_id)) return -1;
+    reactor->slots[timer_id].timer = false;
+    removeFdFromReactor(reactor, timer_id);
+    close(timer_id);
     return 0;
 }
 
@@ -41,25 +198,49 @@ void runReactor(void* reactor_ptr) {
     Reactor* reactor = static_cast<Reactor*>(reactor_ptr);
     reactor->running = true; // Start running now
     while (reactor->running) {
-        fd_set readfds;
+        fd_set readfds, writefds;
         FD_ZERO(&readfds);
-        int maxfd = 0;
-        for (int fd : reactor->fds) {
-            FD_SET(fd, &readfds);
-            if (fd > maxfd) maxfd = fd;
+        FD_ZERO(&writefds);
+        int scanned_max = reactor->max_fd;
+        int maxfd = scanned_max > 0 ? scanned_max : 0;
+        for (int fd = 0; fd <= scanned_max; ++fd) {
+            const FdSlot& slot = reactor->slots[fd];
+            if (slot.read.active()) FD_SET(fd, &readfds);
+            if (slot.write.active()) FD_SET(fd, &writefds);
+        }
+        ++reactor->round;
+        if (reactor->wake_fd >= 0) {
+            FD_SET(reactor->wake_fd, &readfds);
+            if (reactor->wake_fd > maxfd) maxfd = reactor->wake_fd;
+        }
+        // No timeout: timers are fds too, so select only returns on real work
+        int ready = select(maxfd + 1, &readfds, &writefds, nullptr, nullptr);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("select");
+            break;
         }
-        struct timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        int ready = select(maxfd + 1, &readfds, nullptr, nullptr, &tv);
-        if (ready > 0) {
-            // Copy fds to avoid iterator invalidation if a callback removes an fd
-            std::set<int> fds_copy = reactor->fds;
-            for (int fd : fds_copy) {
-                if (FD_ISSET(fd, &readfds) && reactor->fd_to_func.count(fd)) {
-                    reactor->fd_to_func[fd](fd);
-                }
+        if (reactor->wake_fd >= 0 && FD_ISSET(reactor->wake_fd, &readfds)) {
+            uint64_t count;
+            while (read(reactor->wake_fd, &count, sizeof(count)) > 0) {}
+        }
+        // Callbacks may add or remove fds, so each slot is re-read before use;
+        // one registered during this round can't have been selected
+        for (int fd = 0; fd <= scanned_max; ++fd) {
+            if (!FD_ISSET(fd, &readfds)) continue;
+            Handler handler = reactor->slots[fd].read;
+            if (!handler.active() || handler.added_round == reactor->round) continue;
+            if (reactor->slots[fd].timer) {
+                uint64_t expirations;
+                if (read(fd, &expirations, sizeof(expirations)) < 0) continue; // Re-armed meanwhile
             }
+            handler.call(fd);
+        }
+        for (int fd = 0; fd <= scanned_max; ++fd) {
+            if (!FD_ISSET(fd, &writefds)) continue;
+            Handler handler = reactor->slots[fd].write;
+            if (!handler.active() || handler.added_round == reactor->round) continue;
+            handler.call(fd);
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,273 @@
+#include "connection.hpp"
+#include "reactor.hpp"
+#include "metrics.hpp"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <vector>
+
+#define READ_CHUNK 4096
+#define MAX_LINE_BYTES 65536        // A longer line fails the connection
+#define WRITE_COALESCE_BYTES 65536  // Replies held back while more lines are buffered
+#define TURN_LINES 32               // Lines taken in a row before other connections get a turn
+#define FRAME_CLASS_BYTES 64
+#define FRAME_CLASSES 64            // Pooled frames up to 4 KB
+#define FRAME_POOL_MAX_FREE 4096    // Per class; frees beyond this go back to the heap
+
+// ------------------------------------------------------------ Frame pool
+
+static thread_local std::vector<void*> free_frames[FRAME_CLASSES];
+
+void* coroutine_frame_alloc(size_t size) {
+    size_t cls = (size + FRAME_CLASS_BYTES - 1) / FRAME_CLASS_BYTES;
+    if (cls == 0 || cls > FRAME_CLASSES) return ::operator new(size);
+    std::vector<void*>& list = free_frames[cls - 1];
+    if (list.empty()) return ::operator new(cls * FRAME_CLASS_BYTES);
+    void* frame = list.back();
+    list.pop_back();
+    return frame;
+}
+
+void coroutine_frame_free(void* frame, size_t size) {
+    size_t cls = (size + FRAME_CLASS_BYTES - 1) / FRAME_CLASS_BYTES;
+    if (cls == 0 || cls > FRAME_CLASSES || free_frames[cls - 1].size() >= FRAME_POOL_MAX_FREE) {
+        ::operator delete(frame);
+        return;
+    }
+    free_frames[cls - 1].push_back(frame);
+}
+
+void Task::promise_type::unhandled_exception() noexcept {
+    std::terminate(); // Handlers report errors to their client themselves
+}
+
+// ------------------------------------------------------------ Connection
+
+static void* connection_reactor = nullptr;
+
+void set_connection_reactor(void* reactor) {
+    connection_reactor = reactor;
+}
+
+Connection::Connection(int fd) : fd_(fd) {}
+
+Connection::~Connection() {
+    set_reading(false);
+    set_writing(false);
+    close(fd_);
+}
+
+void Connection::set_reading(bool on) {
+    if (on == reading_) return;
+    reading_ = on;
+    if (on) addFdToReactor<Connection, on_readable>(connection_reactor, fd_, this);
+    else removeFdFromReactor(connection_reactor, fd_);
+}
+
+void Connection::set_writing(bool on) {
+    if (on == writing_) return;
+    writing_ = on;
+    if (on) addWriteFdToReactor<Connection, on_writable>(connection_reactor, fd_, this);
+    else removeWriteFdFromReactor(connection_reactor, fd_);
+}
+
+// Each input byte is scanned for a newline once
+bool Connection::scan_line() {
+    size_t from = std::max(scanned_, in_pos_);
+    const char* nl = static_cast<const char*>(memchr(in_.data() + from, '\n', in_.size() - from));
+    if (!nl) {
+        scanned_ = in_.size();
+        return false;
+    }
+    line_end_ = nl - in_.data();
+    has_line_ = true;
+    return true;
+}
+
+// One recv per readiness event, like the callback servers
+void Connection::fill() {
+    if (in_pos_ == in_.size()) {
+        in_.clear();
+        in_pos_ = scanned_ = 0;
+    } else if (in_pos_ > in_.size() / 2) {
+        in_.erase(0, in_pos_);
+        scanned_ -= std::min(scanned_, in_pos_);
+        if (has_line_) line_end_ -= in_pos_;
+        in_pos_ = 0;
+    }
+    char buf[READ_CHUNK];
+    ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+    if (n > 0) {
+        in_.append(buf, n);
+        metrics_add(CTR_BYTES_IN, n);
+        if (in_.size() - in_pos_ > MAX_LINE_BYTES && !has_line()) failed_ = true;
+    } else if (n == 0) {
+        eof_ = true;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        failed_ = true;
+    }
+}
+
+// Sends what it can; true once nothing is left
+bool Connection::flush() {
+    while (out_pos_ < out_.size()) {
+        ssize_t n = send(fd_, out_.data() + out_pos_, out_.size() - out_pos_, MSG_NOSIGNAL);
+        if (n > 0) {
+            metrics_add(CTR_BYTES_OUT, n);
+            out_pos_ += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        } else {
+            failed_ = true;
+            out_.clear();
+            out_pos_ = 0;
+            return false;
+        }
+    }
+    out_.clear();
+    out_pos_ = 0;
+    return true;
+}
+
+// Resumes the handler; it may destroy this Connection, so this comes last
+void Connection::wake() {
+    std::coroutine_handle<> handle = waiter_;
+    waiter_ = nullptr;
+    wait_ = WAIT_NONE;
+    if (handle) handle.resume();
+}
+
+void Connection::cancel() {
+    cancelled_ = true;
+    wake();
+}
+
+// The reactor hands back the Connection registered for the fd
+void Connection::on_readable(int, Connection* conn) {
+    conn->fill();
+    if (conn->eof_ || conn->failed_) conn->set_reading(false);
+    if (conn->wait_ == WAIT_LINE && (conn->has_line() || conn->eof_ || conn->failed_)) conn->wake();
+}
+
+void Connection::on_writable(int, Connection* conn) {
+    if (!conn->flush() && !conn->failed_) return;
+    conn->set_writing(false);
+    if (conn->wait_ == WAIT_DRAIN || conn->failed_ || conn->has_line()) {
+        conn->wake();
+    } else if (conn->wait_ == WAIT_LINE) {
+        conn->set_reading(!conn->eof_); // Output drained: accept input again
+        if (conn->eof_) conn->wake();
+    }
+}
+
+// No buffered line: send the replies held back until now; true if waiting is pointless
+bool Connection::wait_for_input() {
+    flush();
+    return eof_ || failed_;
+}
+
+bool Connection::LineAwaiter::await_ready() {
+    if (conn.cancelled_) return true;
+    if (conn.has_line()) return conn.turn_lines_ < TURN_LINES;
+    return conn.wait_for_input();
+}
+
+// Round-robin: a handler that used up its turn continues after every other
+// ready connection has had one
+void Connection::on_turn(void* ctx) {
+    Connection* conn = static_cast<Connection*>(ctx);
+    std::coroutine_handle<> handle = conn->yielded_;
+    conn->yielded_ = nullptr;
+    handle.resume();
+}
+
+void Connection::LineAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    conn.turn_lines_ = 0;
+    if (conn.has_line()) {
+        // Lines are waiting but the turn is over. Not reading meanwhile keeps
+        // the buffer from growing; the replies so far go out now.
+        conn.yielded_ = handle;
+        conn.flush();
+        conn.set_reading(false);
+        postToReactor(connection_reactor, on_turn, &conn);
+        return;
+    }
+    conn.waiter_ = handle;
+    conn.wait_ = WAIT_LINE;
+    bool blocked = conn.out_pos_ < conn.out_.size();
+    conn.set_writing(blocked);
+    conn.set_reading(!blocked); // Backpressure: no new input until the output drains
+}
+
+std::optional<std::string_view> Connection::LineAwaiter::await_resume() {
+    if (conn.cancelled_) {
+        conn.cancelled_ = false;
+        return std::nullopt;
+    }
+    if (!conn.has_line()) return std::nullopt; // EOF or error; a trailing partial line is dropped
+    ++conn.turn_lines_;
+    const char* begin = conn.in_.data() + conn.in_pos_;
+    size_t len = conn.line_end_ - conn.in_pos_;
+    conn.in_pos_ = conn.line_end_ + 1;
+    conn.has_line_ = false;
+    if (len > 0 && begin[len - 1] == '\r') --len;
+    return std::string_view(begin, len);
+}
+
+Connection::WriteAwaiter Connection::write(std::string data) {
+    if (!failed_) {
+        if (out_.empty()) out_.swap(data);
+        else out_.append(data);
+    }
+    return WriteAwaiter{*this, true};
+}
+
+bool Connection::WriteAwaiter::await_ready() {
+    if (conn.failed_ || conn.cancelled_) return true;
+    // More pipelined lines are already here: their replies go out together
+    if (coalesce && conn.has_line() && conn.out_.size() - conn.out_pos_ < WRITE_COALESCE_BYTES) return true;
+    return conn.flush() || conn.failed_;
+}
+
+void Connection::WriteAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    conn.turn_lines_ = 0;
+    conn.waiter_ = handle;
+    conn.wait_ = WAIT_DRAIN;
+    conn.set_reading(false);
+    conn.set_writing(true);
+}
+
+bool Connection::WriteAwaiter::await_resume() {
+    if (conn.cancelled_) {
+        conn.cancelled_ = false;
+        return false;
+    }
+    return !conn.failed_;
+}
+
+// Both run with the awaiter as context: the work on a worker, the resume
+// on the reactor thread
+static void run_work(void* awaiter) {
+    Connection::WorkAwaiter* self = static_cast<Connection::WorkAwaiter*>(awaiter);
+    self->work(self->ctx);
+}
+
+static void resume_after_work(void* awaiter) {
+    static_cast<Connection::WorkAwaiter*>(awaiter)->handle.resume();
+}
+
+void Connection::WorkAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    this->handle = handle;
+    conn.turn_lines_ = 0;
+    conn.flush(); // Anything still unsent goes out with the next write
+    conn.set_reading(false);
+    submitToReactor(connection_reactor, run_work, resume_after_work, this);
+}
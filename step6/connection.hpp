@@ -0,0 +1,136 @@
+#pragma once
+#include <coroutine>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Sequential connection handlers on top of the reactor.
+//
+// A handler is a coroutine returning Task that owns a Connection:
+//
+//     Task serve(int fd) {
+//         Connection conn(fd);
+//         while (auto line = co_await conn.read_line())
+//             if (!co_await conn.write(reply_to(*line))) break;
+//     }
+//
+// Awaiting suspends the handler until the reactor reports the socket ready,
+// so nothing blocks. Partial lines stay buffered until their newline
+// arrives. While a write waits for the peer to drain its socket the
+// connection stops reading, so a client that doesn't read its replies
+// can't make the server buffer without bound. A handler that has taken
+// many buffered lines in a row is suspended until the next reactor round,
+// so a bulk sender can't hold up the other connections. Everything runs on the
+// reactor thread, except work handed to the reactor's worker pool with
+// offload().
+
+// Coroutine frames come from per-size free lists instead of the heap
+void* coroutine_frame_alloc(size_t size);
+void coroutine_frame_free(void* frame, size_t size);
+
+// A detached coroutine: starts at once, frees its frame when it returns
+struct Task {
+    struct promise_type {
+        Task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept;
+        static void* operator new(size_t size) { return coroutine_frame_alloc(size); }
+        static void operator delete(void* frame, size_t size) { coroutine_frame_free(frame, size); }
+    };
+};
+
+void set_connection_reactor(void* reactor);
+
+template <typename T, void (*Func)(T* ctx)>
+void work_trampoline(void* ctx) {
+    Func(static_cast<T*>(ctx));
+}
+
+class Connection {
+public:
+    explicit Connection(int fd); // fd must be non-blocking
+    ~Connection();               // Closes fd; unsent output is dropped
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    struct LineAwaiter {
+        Connection& conn;
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        std::optional<std::string_view> await_resume();
+    };
+    struct WriteAwaiter {
+        Connection& conn;
+        bool coalesce;
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume();
+    };
+    struct WorkAwaiter {
+        Connection& conn;
+        void (*work)(void* ctx);
+        void* ctx;
+        std::coroutine_handle<> handle;
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() {}
+    };
+
+    // Next line without its "\n" or "\r\n"; nullopt on EOF, error or cancel.
+    // The view points into the input buffer and is valid until the next read_line.
+    LineAwaiter read_line() { return LineAwaiter{*this}; }
+    // Queues data; suspends only if the socket is full. Replies to lines the
+    // client already pipelined are coalesced into one send. false on error or cancel.
+    WriteAwaiter write(std::string data);
+    // Same for a reply appended to output() in place
+    WriteAwaiter write() { return WriteAwaiter{*this, true}; }
+    std::string& output() { return out_; }
+    // Waits until everything written so far is sent; false on error or cancel
+    WriteAwaiter drain() { return WriteAwaiter{*this, false}; }
+    // Runs Func(ctx) on the reactor's worker pool and resumes the handler on
+    // the reactor thread once it returns. Replies so far are sent first; the
+    // connection is not read meanwhile, other connections are served as usual.
+    template <typename T, void (*Func)(T* ctx)>
+    WorkAwaiter offload(T* ctx) { return WorkAwaiter{*this, work_trampoline<T, Func>, ctx, nullptr}; }
+
+    // Wakes the handler: the pending read_line or write fails. Later calls work normally.
+    void cancel();
+
+    int fd() const { return fd_; }
+
+private:
+    enum Wait { WAIT_NONE, WAIT_LINE, WAIT_DRAIN };
+
+    static void on_readable(int fd, Connection* conn);
+    static void on_writable(int fd, Connection* conn);
+    static void on_turn(void* conn);
+    bool has_line() { return has_line_ || scan_line(); }
+    bool scan_line();
+    bool wait_for_input();
+    void fill();
+    bool flush();
+    void set_reading(bool on);
+    void set_writing(bool on);
+    void wake();
+
+    int fd_;
+    std::string in_;
+    size_t in_pos_ = 0;   // Consumed prefix of in_
+    size_t scanned_ = 0;  // in_[in_pos_, scanned_) holds no newline
+    size_t line_end_ = 0; // Newline ending the next line, valid while has_line_
+    bool has_line_ = false;
+    std::string out_;
+    size_t out_pos_ = 0; // Sent prefix of out_
+    std::coroutine_handle<> waiter_;
+    std::coroutine_handle<> yielded_; // Resumed by on_turn, never by cancel
+    int turn_lines_ = 0; // Lines taken since the handler last suspended
+    Wait wait_ = WAIT_NONE;
+    bool eof_ = false;
+    bool failed_ = false;
+    bool cancelled_ = false;
+    bool reading_ = false; // Read interest registered with the reactor
+    bool writing_ = false; // Write interest registered with the reactor
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <charconv>
+#include <string>
+
+// Reply formatting without streams: numbers are written by std::to_chars
+// straight onto the end of an output buffer, so a reply costs no
+// allocation once the buffer has grown. Floats come out exactly as
+// operator<< prints them (%g, 6 significant digits).
+
+inline void append_int(std::string& out, long long value) {
+    char buf[24];
+    std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, r.ptr);
+}
+
+inline void append_float(std::string& out, double value) {
+    char buf[32];
+    std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::general, 6);
+    out.append(buf, r.ptr);
+}
+
+// "(x,y)"
+inline void append_point(std::string& out, float x, float y) {
+    out += '(';
+    append_float(out, x);
+    out += ',';
+    append_float(out, y);
+    out += ')';
+}
@@ -0,0 +1,214 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+// Only the owning thread writes, so updates are a relaxed load and store
+// rather than a locked add; readers may see a value one update stale.
+struct ThreadMetrics {
+    std::atomic<uint64_t> counters[CTR_COUNT];
+    std::atomic<uint64_t> buckets[HIST_COUNT][METRICS_BUCKETS];
+    std::atomic<uint64_t> sum_ns[HIST_COUNT];
+};
+
+static std::mutex registry_mutex;
+static std::set<ThreadMetrics*> live_blocks;
+static MetricsSnapshot exited_totals; // Zero-initialized static
+
+static void bump(std::atomic<uint64_t>& v, uint64_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static void add_block(MetricsSnapshot& snap, const ThreadMetrics& m) {
+    for (int c = 0; c < CTR_COUNT; ++c) snap.counters[c] += m.counters[c].load(std::memory_order_relaxed);
+    for (int h = 0; h < HIST_COUNT; ++h) {
+        for (int b = 0; b < METRICS_BUCKETS; ++b) {
+            uint64_t n = m.buckets[h][b].load(std::memory_order_relaxed);
+            snap.buckets[h][b] += n;
+            snap.count[h] += n;
+        }
+        snap.sum_ns[h] += m.sum_ns[h].load(std::memory_order_relaxed);
+    }
+}
+
+// Registers the block on the thread's first update and folds it into
+// exited_totals when the thread exits, so thread-per-client servers
+// keep their history without growing the registry.
+struct ThreadSlot {
+    ThreadMetrics* metrics = nullptr;
+    ~ThreadSlot() {
+        if (!metrics) return;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        add_block(exited_totals, *metrics);
+        live_blocks.erase(metrics);
+        delete metrics;
+    }
+};
+
+static thread_local ThreadSlot thread_slot;
+
+static ThreadMetrics& local_metrics() {
+    ThreadSlot& slot = thread_slot;
+    if (!slot.metrics) {
+        slot.metrics = new ThreadMetrics(); // Value-initialized: all zero
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        live_blocks.insert(slot.metrics);
+    }
+    return *slot.metrics;
+}
+
+static int bucket_for(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int bucket = 0;
+    while (bucket < METRICS_BUCKETS - 1 && (1ull << bucket) < us) ++bucket;
+    return bucket;
+}
+
+void metrics_add(Counter counter, uint64_t n) {
+    bump(local_metrics().counters[counter], n);
+}
+
+void metrics_observe(Histogram hist, uint64_t ns) {
+    ThreadMetrics& m = local_metrics();
+    bump(m.buckets[hist][bucket_for(ns)], 1);
+    bump(m.sum_ns[hist], ns);
+}
+
+void metrics_snapshot(MetricsSnapshot& snap) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    snap = exited_totals;
+    for (ThreadMetrics* m : live_blocks) add_block(snap, *m);
+}
+
+const char* metrics_counter_name(Counter counter) {
+    static const char* names[CTR_COUNT] = {
+        "connections_accepted", "connections_closed", "bytes_in", "bytes_out", "unknown_commands",
+        "hull_rebuild_waits", "connections_shed", "commands_shed", "admission_overloads"
+    };
+    return names[counter];
+}
+
+const char* metrics_histogram_name(Histogram hist) {
+    static const char* names[HIST_COUNT] = {
+        "Newgraph", "Point", "Newpoint", "Removepoint", "CH", "Other", "convex_hull", "lock_wait", "monitor_lag",
+        "replication_lag", "admission_wait"
+    };
+    return names[hist];
+}
+
+uint64_t metrics_bucket_bound_us(int bucket) {
+    return 1ull << bucket;
+}
+
+// Upper bound of the bucket holding the p-th quantile
+static uint64_t quantile_us(const MetricsSnapshot& snap, int hist, double p) {
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * snap.count[hist])));
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; ++b) {
+        seen += snap.buckets[hist][b];
+        if (seen >= rank) return metrics_bucket_bound_us(b);
+    }
+    return metrics_bucket_bound_us(METRICS_BUCKETS - 1);
+}
+
+std::string metrics_report() {
+    MetricsSnapshot snap;
+    metrics_snapshot(snap);
+    std::ostringstream out;
+    out << "Connections: " << snap.counters[CTR_CONNECTIONS_ACCEPTED] << " accepted, "
+        << snap.counters[CTR_CONNECTIONS_ACCEPTED] - snap.counters[CTR_CONNECTIONS_CLOSED] << " active\n";
+    out << "Bytes: " << snap.counters[CTR_BYTES_IN] << " in, " << snap.counters[CTR_BYTES_OUT] << " out\n";
+    out << "Unknown commands: " << snap.counters[CTR_UNKNOWN_COMMANDS] << "\n";
+    if (snap.counters[CTR_HULL_REBUILD_WAITS])
+        out << "Shared hull rebuilds: " << snap.counters[CTR_HULL_REBUILD_WAITS] << " readers waited\n";
+    if (snap.counters[CTR_CONNECTIONS_SHED] || snap.counters[CTR_COMMANDS_SHED])
+        out << "Shed: " << snap.counters[CTR_CONNECTIONS_SHED] << " connections, "
+            << snap.counters[CTR_COMMANDS_SHED] << " commands, "
+            << snap.counters[CTR_ADMISSION_OVERLOADS] << " overload periods\n";
+    for (int h = 0; h < HIST_COUNT; ++h) {
+        if (snap.count[h] == 0) continue;
+        out << metrics_histogram_name(static_cast<Histogram>(h)) << ": " << snap.count[h]
+            << " calls, avg " << snap.sum_ns[h] / snap.count[h] / 1000.0 << " us"
+            << ", p50 <= " << quantile_us(snap, h, 0.50) << " us"
+            << ", p99 <= " << quantile_us(snap, h, 0.99) << " us\n";
+    }
+    out << "End of stats.\n";
+    return out.str();
+}
+
+// Command histograms share one metric family with a command label
+static void prometheus_family(int hist, std::string& name, std::string& label) {
+    switch (hist) {
+    case HIST_CONVEX_HULL: name = "ch_convex_hull_duration_seconds"; break;
+    case HIST_LOCK_WAIT: name = "ch_graph_lock_wait_seconds"; break;
+    case HIST_MONITOR_LAG: name = "ch_monitor_lag_seconds"; break;
+    case HIST_REPLICATION_LAG: name = "ch_replication_lag_seconds"; break;
+    case HIST_ADMISSION_WAIT: name = "ch_admission_wait_seconds"; break;
+    default:
+        name = "ch_command_duration_seconds";
+        label = "command=" + metrics_label(metrics_histogram_name(static_cast<Histogram>(hist)));
+    }
+}
+
+std::string metrics_prometheus() {
+    MetricsSnapshot snap;
+    metrics_snapshot(snap);
+    std::ostringstream out;
+    out.precision(10); // Bucket bounds print exactly
+    for (int c = 0; c < CTR_COUNT; ++c) {
+        const char* name = metrics_counter_name(static_cast<Counter>(c));
+        out << "# TYPE ch_" << name << "_total counter\n"
+            << "ch_" << name << "_total " << snap.counters[c] << "\n";
+    }
+    out << "# TYPE ch_connections_active gauge\n"
+        << "ch_connections_active "
+        << snap.counters[CTR_CONNECTIONS_ACCEPTED] - snap.counters[CTR_CONNECTIONS_CLOSED] << "\n";
+
+    std::string last_family;
+    for (int h = 0; h < HIST_COUNT; ++h) {
+        std::string name, label;
+        prometheus_family(h, name, label);
+        if (name != last_family) out << "# TYPE " << name << " histogram\n";
+        last_family = name;
+        std::string sep = label.empty() ? "" : ",";
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRICS_BUCKETS - 1; ++b) {
+            cumulative += snap.buckets[h][b];
+            out << name << "_bucket{" << label << sep << "le=\"" << metrics_bucket_bound_us(b) / 1e6
+                << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{" << label << sep << "le=\"+Inf\"} " << snap.count[h] << "\n";
+        std::string braces = label.empty() ? "" : "{" + label + "}";
+        out << name << "_sum" << braces << " " << snap.sum_ns[h] / 1e9 << "\n";
+        out << name << "_count" << braces << " " << snap.count[h] << "\n";
+    }
+    return out.str();
+}
+
+std::string metrics_label(const std::string& value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"') quoted += '\\';
+        if (c == '\n') {
+            quoted += "\\n";
+            continue;
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+std::string metrics_http_response(const std::string& request, const std::string& body) {
+    std::ostringstream out;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 14, "GET /metrics\r\n") == 0) {
+        out << "HTTP/1.0 200 OK\r\n"
+            << "Content-Type: text/plain; version=0.0.4\r\n"
+            << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+    } else {
+        out << "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+    return out.str();
+}
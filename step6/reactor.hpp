@@ -1,9 +1,63 @@
 #pragma once
 
 typedef void (*reactorFunc)(int fd);
+// Callback with the context pointer given at registration
+typedef void (*reactorCtxFunc)(int fd, void* ctx);
 
 void* startReactor();
+// Registering an fd >= FD_SETSIZE, which select() can't watch, fails with -1
 int addFdToReactor(void* reactor, int fd, reactorFunc func);
+int addFdToReactorCtx(void* reactor, int fd, reactorCtxFunc func, void* ctx);
 int removeFdFromReactor(void* reactor, int fd);
+// Write readiness is registered separately from read readiness on the same fd
+int addWriteFdToReactor(void* reactor, int fd, reactorFunc func);
+int addWriteFdToReactorCtx(void* reactor, int fd, reactorCtxFunc func, void* ctx);
+int removeWriteFdFromReactor(void* reactor, int fd);
+// Context of fd's read registration, or nullptr; O(1)
+void* getReactorFdContext(void* reactor, int fd);
 int stopReactor(void* reactor);
-void runReactor(void* reactor); // Add this line for running the event loop
\ No newline at end of file
+void runReactor(void* reactor); // Add this line for running the event loop
+
+// Timers are timerfds owned by the reactor; the callback receives the timer id.
+// interval_ms == 0 makes a one-shot timer, which stays registered (disarmed)
+// after it fires until it is re-armed or removed.
+int addTimerToReactor(void* reactor, unsigned int initial_ms, unsigned int interval_ms, reactorFunc func);
+int addTimerToReactorCtx(void* reactor, unsigned int initial_ms, unsigned int interval_ms, reactorCtxFunc func, void* ctx);
+int rearmTimerInReactor(void* reactor, int timer_id, unsigned int initial_ms, unsigned int interval_ms);
+int removeTimerFromReactor(void* reactor, int timer_id);
+
+// Executor: work(ctx) runs on one of the reactor's worker threads, then
+// done(ctx) runs on the reactor thread, which learns of it through an
+// eventfd. Without workers, both run at once on the calling thread.
+// Workers are joined when runReactor returns; done is not called for work
+// still queued then.
+typedef void (*reactorWorkFunc)(void* ctx);
+int startReactorWorkers(void* reactor, int workers);
+int submitToReactor(void* reactor, reactorWorkFunc work, reactorWorkFunc done, void* ctx);
+
+// Runs func(ctx) on the loop thread next round, after that round's I/O
+// callbacks, in the order posted. select() doesn't block while any are
+// waiting. Loop thread only.
+int postToReactor(void* reactor, reactorWorkFunc func, void* ctx);
+
+// Typed registration: Func receives the T* it was registered with, e.g.
+//     addFdToReactor<Client, on_client_readable>(reactor, fd, client);
+template <typename T, void (*Func)(int fd, T* ctx)>
+void reactorTrampoline(int fd, void* ctx) {
+    Func(fd, static_cast<T*>(ctx));
+}
+
+template <typename T, void (*Func)(int fd, T* ctx)>
+int addFdToReactor(void* reactor, int fd, T* ctx) {
+    return addFdToReactorCtx(reactor, fd, reactorTrampoline<T, Func>, ctx);
+}
+
+template <typename T, void (*Func)(int fd, T* ctx)>
+int addWriteFdToReactor(void* reactor, int fd, T* ctx) {
+    return addWriteFdToReactorCtx(reactor, fd, reactorTrampoline<T, Func>, ctx);
+}
+
+template <typename T, void (*Func)(int timer_id, T* ctx)>
+int addTimerToReactor(void* reactor, unsigned int initial_ms, unsigned int interval_ms, T* ctx) {
+    return addTimerToReactorCtx(reactor, initial_ms, interval_ms, reactorTrampoline<T, Func>, ctx);
+}
@@ -1,6 +1,28 @@
 #include "server_reactor.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
 
-int main() {
-    run_server_reactor(9034);
+int main(int argc, char* argv[]) {
+    int port = 9034;
+    int backlog = DEFAULT_BACKLOG;
+    int metrics_port = 0;
+    int workers = DEFAULT_HULL_WORKERS;
+    std::string unix_path;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:m:t:u:")) != -1) {
+        switch (opt) {
+        case 'p': port = std::atoi(optarg); break;
+        case 'b': backlog = std::atoi(optarg); break;
+        case 'm': metrics_port = std::atoi(optarg); break;
+        case 't': workers = std::atoi(optarg); break;
+        case 'u': unix_path = optarg; break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-p port] [-b backlog] [-m metrics_port] [-t hull_workers]"
+                      << " [-u unix_path|@name]" << std::endl;
+            return 1;
+        }
+    }
+    run_server_reactor(port, backlog, metrics_port, workers, unix_path);
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "reactor.hpp"
+#include "connection.hpp"
 #include "convex_hull.hpp"
+#include "metrics.hpp"
+#include "format.hpp"
+#include "parse.hpp"
+#include "listener.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -10,211 +15,489 @@
 #include <sstream>
 #include <algorithm>
 #include <iostream>
-#include <map>
+#include <chrono>
+#include <optional>
+#include <cerrno>
 #include <fcntl.h>
 
-#define BACKLOG 10
 #define BUFSIZE 1024
+#define ACCEPT_BATCH 64 // Max accepts per readiness event, so a storm can't starve reads
+// Each client holds two fds (socket and idle timerfd) and select() only
+// sees fds below FD_SETSIZE; a few are left for listeners, scrapes and the loop
+#define MAX_CLIENTS ((FD_SETSIZE - 32) / 2)
+#define IDLE_TIMEOUT_MS 300000 // Evict connections silent for 5 minutes
+#define IDLE_GRACE_MS 1000 // How long the goodbye may take before the connection is dropped
+#define MAX_SCRAPE_REQUEST 8192 // Bytes of HTTP request read before answering anyway
+#define SCRAPE_TIMEOUT_MS 10000 // A scrape not answered and sent by then is dropped
+#define OFFLOAD_MIN_POINTS 4096 // Smaller hulls are cheaper to compute than to hand off
+
+// Per-connection state lives in the handler's coroutine frame; the idle
+// timer is registered with a pointer to it.
+struct ClientState {
+    Connection* conn = nullptr;
+    int idle_timer = -1;
+    bool timed_out = false;
+    std::chrono::steady_clock::time_point last_activity;
+};
 
 static std::vector<Point> points;
-static std::map<int, int> points_to_read; // fd -> points left to read
+static size_t last_hull_vertices = 0;        // From the most recent CH
 static void* global_reactor = nullptr;
+static int reserve_fd = -1; // Spare descriptor released to shed connections on EMFILE
+static int hull_workers = 0;
+static int clients = 0; // Connections being served
+
+// A CH computed on the worker pool. The points are copied on the reactor
+// thread, so other clients can change the graph while the hull is built.
+struct HullJob {
+    std::vector<Point> points;
+    std::vector<Point> hull;
+    std::string error;
+};
+
+// accept4() that survives descriptor exhaustion: on EMFILE/ENFILE the reserve
+// fd is released so the pending connection can be accepted and closed at once,
+// instead of leaving the listener readable forever. Returns -1 with errno set
+// when nothing was handed out (EAGAIN once the backlog is drained).
+static int accept_client(int listener, int flags) {
+    while (true) {
+        int fd = accept4(listener, nullptr, nullptr, flags);
+        if (fd >= 0) return fd;
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        if ((errno == EMFILE || errno == ENFILE) && reserve_fd >= 0) {
+            close(reserve_fd);
+            int shed = accept(listener, nullptr, nullptr);
+            if (shed >= 0) close(shed);
+            reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            std::cerr << "accept: out of file descriptors, connection shed\n";
+            errno = EMFILE;
+        }
+        return -1;
+    }
+}
+
+// Drops one stored point per listed point in a single pass; returns how
+// many were found
+static size_t remove_many(std::vector<Point>& targets) {
+    std::sort(targets.begin(), targets.end());
+    std::vector<bool> taken(targets.size(), false);
+    size_t removed = 0;
+    auto keep = points.begin();
+    for (auto it = points.begin(); it != points.end(); ++it) {
+        size_t i = std::lower_bound(targets.begin(), targets.end(), *it) - targets.begin();
+        while (i < targets.size() && !(*it < targets[i]) && taken[i]) ++i;
+        if (i < targets.size() && !(*it < targets[i])) {
+            taken[i] = true;
+            ++removed;
+            continue;
+        }
+        *keep++ = *it;
+    }
+    points.erase(keep, points.end());
+    return removed;
+}
 
-std::string handle_command(const std::string& cmdline) {
-    std::istringstream iss(cmdline);
-    std::string cmd;
-    iss >> cmd;
-    std::ostringstream response;
-
-    if (cmd == "Newgraph") {
-        int n;
-        if (!(iss >> n) || n < 1) {
-            response << "Invalid usage. Example: Newgraph 4\n";
-            return response.str();
-        }
-        points.clear();
-        response << "OK. Send " << n << " points (x,y per line):\n";
-        return response.str();
-    } else if (cmd == "CH") {
+static void compute_hull(HullJob* job) {
+    try {
+        MetricsTimer hull_timer(HIST_CONVEX_HULL);
+        job->hull = convex_hull(job->points);
+    } catch (const std::exception& ex) {
+        job->error = ex.what();
+    }
+    job->points = std::vector<Point>(); // Freed here rather than on the reactor thread
+}
+
+static void append_hull(const std::vector<Point>& hull, std::string& out) {
+    last_hull_vertices = hull.size();
+    out += "Convex hull area: ";
+    append_float(out, convex_hull_area(hull));
+    out += '\n';
+}
+
+static Histogram command_histogram(CommandId id) {
+    switch (id) {
+    case CMD_NEWGRAPH: return HIST_CMD_NEWGRAPH;
+    case CMD_NEWPOINT:
+    case CMD_NEWPOINTS: return HIST_CMD_NEWPOINT;
+    case CMD_REMOVEPOINT:
+    case CMD_REMOVEPOINTS: return HIST_CMD_REMOVEPOINT;
+    case CMD_CH: return HIST_CMD_CH;
+    default: return HIST_CMD_OTHER;
+    }
+}
+
+// Appends the reply to out. Newgraph is handled by handle_line, which
+// owns the per-client point countdown.
+static void handle_command(const CommandLine& cmd, std::string& out) {
+    MetricsTimer timer(command_histogram(cmd.id));
+
+    switch (cmd.id) {
+    case CMD_CH:
         try {
             if (points.size() < 3) {
-                response << "Need at least 3 points to compute convex hull.\n";
+                out += "Need at least 3 points to compute convex hull.\n";
             } else {
-                std::vector<Point> hull = convex_hull(points);
-                float area = convex_hull_area(hull);
-                response << "Convex hull area: " << area << "\n";
+                std::vector<Point> hull;
+                {
+                    MetricsTimer hull_timer(HIST_CONVEX_HULL);
+                    hull = convex_hull(points);
+                }
+                append_hull(hull, out);
             }
         } catch (const std::exception& ex) {
-            response << "Error: " << ex.what() << "\n";
-        }
-        return response.str();
-    } else if (cmd == "Newpoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
-            return response.str();
-        }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
+            out += "Error: ";
+            out += ex.what();
+            out += '\n';
+        }
+        break;
+    case CMD_NEWPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Newpoint 1,2\n";
+            return;
+        }
+        points.push_back(p);
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        out += " added.\n";
+        break;
+    }
+    case CMD_REMOVEPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Removepoint 1,2\n";
+            return;
+        }
+        auto it = std::find_if(points.begin(), points.end(),
+            [&p](const Point& q) { return q.x == p.x && q.y == p.y; });
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        if (it != points.end()) {
+            points.erase(it);
+            out += " removed.\n";
         } else {
-            points.push_back({x, y});
-            response << "Point (" << x << "," << y << ") added.\n";
-        }
-        return response.str();
-    } else if (cmd == "Removepoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
-            return response.str();
-        }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
+            out += " not found.\n";
+        }
+        break;
+    }
+    case CMD_NEWPOINTS: {
+        std::vector<Point> batch;
+        if (!parse_points(cmd.rest, batch)) {
+            out += "Invalid usage. Example: Newpoints 1,2 3,4\n";
+            return;
+        }
+        points.insert(points.end(), batch.begin(), batch.end());
+        append_int(out, batch.size());
+        out += " points added. Graph has ";
+        append_int(out, points.size());
+        out += " points.\n";
+        break;
+    }
+    case CMD_REMOVEPOINTS: {
+        std::vector<Point> batch;
+        if (!parse_points(cmd.rest, batch)) {
+            out += "Invalid usage. Example: Removepoints 1,2 3,4\n";
+            return;
+        }
+        size_t n = batch.size();
+        append_int(out, remove_many(batch));
+        out += " of ";
+        append_int(out, n);
+        out += " points removed.\n";
+        break;
+    }
+    case CMD_STATS:
+        out += metrics_report();
+        break;
+    default:
+        metrics_add(CTR_UNKNOWN_COMMANDS);
+        out += "Unknown command.\n";
+        break;
+    }
+}
+
+// Fires at most once per idle period; activity only updates last_activity,
+// so busy connections cost no timer syscalls. An idle client's handler is
+// woken to say goodbye; if even that write stalls, the grace timer ends it.
+static void on_idle_timer(int timer_id, ClientState* client) {
+    ClientState& state = *client;
+    if (state.timed_out) {
+        state.conn->cancel();
+        return;
+    }
+    auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - state.last_activity).count();
+    if (idle < IDLE_TIMEOUT_MS) {
+        rearmTimerInReactor(global_reactor, timer_id, IDLE_TIMEOUT_MS - idle, 0);
+        return;
+    }
+    std::cout << "Socket " << state.conn->fd() << " idle for " << idle / 1000 << "s, closing\n";
+    state.timed_out = true;
+    rearmTimerInReactor(global_reactor, timer_id, IDLE_GRACE_MS, 0);
+    state.conn->cancel();
+}
+
+// A point line while a Newgraph is being filled, otherwise a command;
+// the reply is appended to out. Returns true, with nothing appended, for a
+// CH the caller should hand to the worker pool.
+static bool handle_line(std::string_view line, int& points_to_read, std::string& out) {
+    if (points_to_read > 0) {
+        MetricsTimer timer(HIST_CMD_POINT);
+        Point p;
+        if (!parse_point(line, p)) {
+            out += "Invalid point format. Example: 1,2\n";
         } else {
-            auto it = std::find_if(points.begin(), points.end(),
-                [x, y](const Point& p) { return p.x == x && p.y == y; });
-            if (it != points.end()) {
-                points.erase(it);
-                response << "Point (" << x << "," << y << ") removed.\n";
+            points.push_back(p);
+            points_to_read--;
+            if (points_to_read == 0) {
+                out += "Graph updated with ";
+                append_int(out, points.size());
+                out += " points.\n";
             } else {
-                response << "Point (" << x << "," << y << ") not found.\n";
+                out += "Point added. ";
+                append_int(out, points_to_read);
+                out += " more to go.\n";
             }
         }
-        return response.str();
-    } else {
-        response << "Unknown command.\n";
-        return response.str();
+        return false;
     }
+
+    CommandLine cmd;
+    parse_command(line, cmd);
+    if (cmd.id == CMD_CH && hull_workers > 0 && points.size() >= OFFLOAD_MIN_POINTS) return true;
+    if (cmd.id != CMD_NEWGRAPH) {
+        handle_command(cmd, out);
+        return false;
+    }
+    MetricsTimer timer(HIST_CMD_NEWGRAPH);
+    int n;
+    if (cmd.argc < 1 || !parse_count(cmd.args[0], n)) {
+        out += "Invalid usage. Example: Newgraph 4\n";
+        return false;
+    }
+    points.clear();
+    last_hull_vertices = 0;
+    points_to_read = n;
+    out += "OK. Send ";
+    append_int(out, n);
+    out += " points (x,y per line):\n";
+    return false;
 }
 
-void on_client(int fd) {
-    char buf[BUFSIZE];
-    int nbytes = recv(fd, buf, sizeof(buf) - 1, 0);
-    if (nbytes <= 0) {
-        if (nbytes == 0) {
-            std::cout << "Socket " << fd << " hung up\n";
-        } else {
-            perror("recv");
-        }
-        removeFdFromReactor(global_reactor, fd);
-        close(fd);
-        points_to_read.erase(fd);
-        return;
+// One coroutine per client, written as a plain request loop
+static Task serve_client(int fd) {
+    Connection conn(fd);
+    ClientState state;
+    state.conn = &conn;
+    state.last_activity = std::chrono::steady_clock::now();
+    state.idle_timer = addTimerToReactor<ClientState, on_idle_timer>(global_reactor, IDLE_TIMEOUT_MS, 0, &state);
+    if (state.idle_timer < 0) {
+        // Without it an idle client would never be evicted
+        std::cerr << "Socket " << fd << ": no idle timer, closing\n";
+        metrics_add(CTR_CONNECTIONS_CLOSED);
+        co_return;
     }
-    buf[nbytes] = '\0';
-
-    std::istringstream iss(buf);
-    std::string line;
-    std::ostringstream response;
-    while (std::getline(iss, line)) {
-        if (line.empty()) continue;
-
-        if (points_to_read.count(fd) && points_to_read[fd] > 0) {
-            std::replace(line.begin(), line.end(), ',', ' ');
-            std::istringstream point_iss(line);
-            float x, y;
-            std::ostringstream point_response;
-            if (!(point_iss >> x >> y)) {
-                point_response << "Invalid point format. Example: 1,2\n";
+    clients++;
+    int points_to_read = 0;
+
+    bool ok = co_await conn.write("Welcome to the Convex Hull Server!\n");
+    while (ok) {
+        std::optional<std::string_view> line = co_await conn.read_line();
+        if (!line) break;
+        state.last_activity = std::chrono::steady_clock::now();
+        if (line->empty()) continue;
+        if (handle_line(*line, points_to_read, conn.output())) {
+            // The reactor keeps serving other clients while the hull is built
+            MetricsTimer timer(HIST_CMD_CH);
+            HullJob job;
+            job.points = points;
+            co_await conn.offload<HullJob, compute_hull>(&job);
+            if (job.error.empty()) {
+                append_hull(job.hull, conn.output());
             } else {
-                points.push_back({x, y});
-                points_to_read[fd]--;
-                if (points_to_read[fd] == 0) {
-                    point_response << "Graph updated with " << points.size() << " points.\n";
-                    points_to_read.erase(fd);
-                } else {
-                    point_response << "Point added. " << points_to_read[fd] << " more to go.\n";
-                }
+                conn.output() += "Error: " + job.error + "\n";
             }
-            response << point_response.str();
+        }
+        ok = co_await conn.write();
+    }
+    if (state.timed_out) {
+        // false once the grace timer cancelled it: the client isn't reading,
+        // and with that one-shot timer spent nothing would end a drain
+        ok = co_await conn.write("Idle timeout, closing connection.\n");
+    } else {
+        std::cout << "Socket " << fd << " hung up\n";
+        ok = true;
+    }
+    if (ok) co_await conn.drain(); // A half-closed client may still be reading
+
+    removeTimerFromReactor(global_reactor, state.idle_timer);
+    clients--;
+    metrics_add(CTR_CONNECTIONS_CLOSED);
+}
+
+void on_new_connection(int listener_fd) {
+    // Drain pending connections in batches; select() reports the rest next turn
+    int newfd = 0;
+    int accepted = 0;
+    while (accepted++ < ACCEPT_BATCH &&
+           (newfd = accept_client(listener_fd, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        if (newfd >= FD_SETSIZE || clients >= MAX_CLIENTS) {
+            std::cerr << "accept: fd " << newfd << " past the select() limit, closing\n";
+            close(newfd);
             continue;
         }
+        std::cout << "[SERVER] New client connected: fd=" << newfd << std::endl;
+        metrics_add(CTR_CONNECTIONS_ACCEPTED);
+        serve_client(newfd); // Runs until its first wait for input
+    }
+    if (newfd == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EMFILE && errno != ENFILE) {
+        perror("accept");
+    }
+}
 
-        if (line.find("Newgraph") == 0) {
-            std::istringstream liss(line);
-            std::string cmd, n_str;
-            liss >> cmd;
-            if (!(liss >> n_str)) {
-                response << "Invalid usage. Example: Newgraph 4\n";
-                continue;
-            }
-            int n;
-            std::istringstream n_iss(n_str);
-            if (!(n_iss >> n) || n < 1) {
-                response << "Invalid usage. Example: Newgraph 4\n";
-                continue;
-            }
-            points.clear();
-            points_to_read[fd] = n;
-            response << "OK. Send " << n << " points (x,y per line):\n";
+static std::string prometheus_body() {
+    std::ostringstream gauges;
+    gauges << "# TYPE ch_graph_points gauge\n"
+           << "ch_graph_points{graph=\"default\"} " << points.size() << "\n"
+           << "# TYPE ch_graph_hull_vertices gauge\n"
+           << "ch_graph_hull_vertices{graph=\"default\"} " << last_hull_vertices << "\n";
+    return metrics_prometheus() + gauges.str();
+}
+
+// A scrape in progress: the request until its blank line, then the reply
+// still to be sent. Registered as the context of its socket and its timer.
+struct Scrape {
+    int fd = -1;
+    std::string request;
+    std::string reply;
+    size_t sent = 0;
+    int timer = -1;
+};
+
+static void finish_scrape(int fd, Scrape* scrape) {
+    removeFdFromReactor(global_reactor, fd);
+    removeWriteFdFromReactor(global_reactor, fd);
+    if (scrape->timer >= 0) removeTimerFromReactor(global_reactor, scrape->timer);
+    close(fd);
+    delete scrape;
+}
+
+// Sends what the socket takes now; false once the scrape is over, sent or failed
+static bool send_scrape(int fd, Scrape* scrape) {
+    while (scrape->sent < scrape->reply.size()) {
+        ssize_t n = send(fd, scrape->reply.data() + scrape->sent, scrape->reply.size() - scrape->sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            metrics_add(CTR_BYTES_OUT, n);
+            scrape->sent += n;
+        } else if (n < 0 && errno == EINTR) {
             continue;
+        } else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
         }
+    }
+    return false;
+}
 
-        response << handle_command(line);
+static void on_scrape_writable(int fd, Scrape* scrape) {
+    if (!send_scrape(fd, scrape)) finish_scrape(fd, scrape);
+}
+
+// Scrapes are reactor fds like clients: buffer the request until its blank
+// line, answer, close. A reply the socket can't take at once is finished on
+// write readiness, so a scraper that doesn't read never blocks the loop.
+// The graph is only touched on this thread, so reading it needs no lock.
+static void on_scrape(int fd, Scrape* scrape) {
+    char buf[BUFSIZE];
+    ssize_t nbytes = recv(fd, buf, sizeof(buf), 0);
+    if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (nbytes > 0) {
+        scrape->request.append(buf, nbytes);
+        if (scrape->request.find("\r\n\r\n") == std::string::npos && scrape->request.size() < MAX_SCRAPE_REQUEST) {
+            return;
+        }
+        scrape->reply = metrics_http_response(scrape->request, prometheus_body());
+        removeFdFromReactor(global_reactor, fd);
+        if (send_scrape(fd, scrape) && addWriteFdToReactor<Scrape, on_scrape_writable>(global_reactor, fd, scrape) == 0) {
+            return;
+        }
     }
-    std::string resp = response.str();
-    send(fd, resp.c_str(), resp.size(), 0);
+    finish_scrape(fd, scrape);
 }
 
-void on_new_connection(int listener_fd) {
-    while (true) {
-        struct sockaddr_in clientaddr;
-        socklen_t addrlen = sizeof(clientaddr);
-        int newfd = accept(listener_fd, (struct sockaddr*)&clientaddr, &addrlen);
-        if (newfd == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            } else {
-                perror("accept");
-                break;
-            }
+static void on_scrape_timeout(int, Scrape* scrape) {
+    finish_scrape(scrape->fd, scrape);
+}
+
+void on_metrics_connection(int listener_fd) {
+    int fd;
+    while ((fd = accept4(listener_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        if (fd >= FD_SETSIZE) {
+            close(fd);
+            continue;
+        }
+        Scrape* scrape = new Scrape();
+        scrape->fd = fd;
+        scrape->timer = addTimerToReactor<Scrape, on_scrape_timeout>(global_reactor, SCRAPE_TIMEOUT_MS, 0, scrape);
+        if (scrape->timer < 0 || addFdToReactor<Scrape, on_scrape>(global_reactor, fd, scrape) < 0) {
+            finish_scrape(fd, scrape);
         }
-        std::cout << "[SERVER] New client connected: fd=" << newfd << std::endl;
-        std::string welcome = "Welcome to the Convex Hull Server!\n";
-        send(newfd, welcome.c_str(), welcome.size(), 0);
-        addFdToReactor(global_reactor, newfd, on_client);
     }
 }
 
-void run_server_reactor(int port) {
-    int listener = socket(AF_INET, SOCK_STREAM, 0);
+static int create_metrics_listener(int port) {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (listener < 0) {
-        perror("socket");
-        return;
+        perror("socket (metrics)");
+        return -1;
     }
 
     int yes = 1;
     setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
 
-    struct sockaddr_in serveraddr;
-    memset(&serveraddr, 0, sizeof(serveraddr));
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_addr.s_addr = INADDR_ANY;
-    serveraddr.sin_port = htons(port);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
 
-    if (bind(listener, (struct sockaddr*)&serveraddr, sizeof(serveraddr)) < 0) {
-        perror("bind");
-        return;
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 16) < 0) {
+        perror("metrics listener");
+        close(listener);
+        return -1;
     }
+    std::cout << "Metrics on port " << port << " (/metrics)" << std::endl;
+    return listener;
+}
 
-    if (listen(listener, BACKLOG) < 0) {
-        perror("listen");
+void run_server_reactor(int port, int backlog, int metrics_port, int workers, const std::string& unix_path) {
+    int listener = -1, unix_listener = -1;
+    if (port <= 0 && unix_path.empty()) {
+        std::cerr << "Nothing to listen on: give a TCP port or a Unix socket path" << std::endl;
+        return;
+    }
+    if (port > 0 && (listener = open_tcp_listener(port, backlog, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) return;
+    if (!unix_path.empty() &&
+        (unix_listener = open_unix_listener(unix_path, backlog, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+        if (listener >= 0) close(listener);
         return;
     }
-    fcntl(listener, F_SETFL, O_NONBLOCK);
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
 
-    std::cout << "Server started on port " << port << std::endl;
+    if (listener >= 0) std::cout << "Server started on port " << port << std::endl;
+    if (unix_listener >= 0) std::cout << "Server started on Unix socket " << unix_path << std::endl;
 
     global_reactor = startReactor();
-    addFdToReactor(global_reactor, listener, on_new_connection);
+    if (workers > 0 && startReactorWorkers(global_reactor, workers) == 0) hull_workers = workers;
+    set_connection_reactor(global_reactor);
+    if (listener >= 0) addFdToReactor(global_reactor, listener, on_new_connection);
+    if (unix_listener >= 0) addFdToReactor(global_reactor, unix_listener, on_new_connection);
+    int metrics_listener = metrics_port > 0 ? create_metrics_listener(metrics_port) : -1;
+    if (metrics_listener >= 0) addFdToReactor(global_reactor, metrics_listener, on_metrics_connection);
 
     runReactor(global_reactor);
 
     stopReactor(global_reactor);
-    close(listener);
+    if (metrics_listener >= 0) close(metrics_listener);
+    if (unix_listener >= 0) close(unix_listener);
+    if (listener >= 0) close(listener);
 }
\ No newline at end of file
@@ -1,4 +1,15 @@
 #pragma once
+#include <string>
+
+// Default listen() backlog; the kernel clamps it to net.core.somaxconn
+#define DEFAULT_BACKLOG 1024
+// Threads that compute CH for large graphs off the reactor thread
+#define DEFAULT_HULL_WORKERS 2
 
 // Start the reactor-based convex hull server (blocking call)
-void run_server_reactor(int port = 9034);
\ No newline at end of file
+// metrics_port > 0 also serves Prometheus /metrics on that port; workers == 0
+// computes every CH on the reactor thread. Clients connect over TCP unless
+// port is 0, and on the Unix socket unix_path ('@' first for the abstract
+// namespace) unless that is empty.
+void run_server_reactor(int port = 9034, int backlog = DEFAULT_BACKLOG, int metrics_port = 0,
+                        int workers = DEFAULT_HULL_WORKERS, const std::string& unix_path = "");
\ No newline at end of file
@@ -2,8 +2,10 @@
 #include <iostream>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <cstddef>
 #include <cstring>
 
 int connect_to_server(const std::string& host, const std::string& port) {
@@ -33,6 +35,28 @@ int connect_to_server(const std::string& host, const std::string& port) {
     return sockfd;
 }
 
+int connect_to_unix(const std::string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Bad Unix socket path: " << path << std::endl;
+        return -1;
+    }
+    bool abstract = path[0] == '@';
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (abstract) addr.sun_path[0] = '\0';
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1);
+
+    int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd == -1) return -1;
+    if (connect(sockfd, (struct sockaddr*)&addr, len) == -1) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
 void run_client(int sockfd) {
     char buf[1024];
     ssize_t numbytes = recv(sockfd, buf, sizeof(buf) - 1, 0);
@@ -1,10 +1,23 @@
 #include "client.hpp"
 #include <iostream>
+#include <unistd.h>
 
-int main() {
+int main(int argc, char* argv[]) {
     std::string host = "127.0.0.1";
     std::string port = "9034";
-    int sockfd = connect_to_server(host, port);
+    std::string unix_path;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:u:")) != -1) {
+        switch (opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = optarg; break;
+        case 'u': unix_path = optarg; break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-h host] [-p port] [-u unix_path|@name]" << std::endl;
+            return 1;
+        }
+    }
+    int sockfd = unix_path.empty() ? connect_to_server(host, port) : connect_to_unix(unix_path);
     if (sockfd == -1) {
         std::cerr << "Failed to connect to server." << std::endl;
         return 1;
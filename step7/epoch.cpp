@@ -0,0 +1,96 @@
+#include "epoch.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// One record per thread that ever read; records are recycled, never freed.
+// epoch == 0 means the thread is outside any guard.
+struct EpochRecord {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> in_use{false};
+    EpochRecord* next = nullptr;
+};
+
+struct RetiredObject {
+    void* ptr;
+    EpochDeleter deleter;
+    uint64_t epoch;
+};
+
+#define EPOCH_RECLAIM_BATCH 32 // Scan the reader records once per this many retirements
+
+static std::atomic<uint64_t> global_epoch(1);
+static std::atomic<EpochRecord*> records(nullptr);
+static std::mutex retire_mutex; // Writers only; readers never touch it
+static std::vector<RetiredObject> retired;
+
+static EpochRecord* acquire_record() {
+    for (EpochRecord* r = records.load(); r; r = r->next) {
+        bool expected = false;
+        if (!r->in_use.load(std::memory_order_relaxed) &&
+            r->in_use.compare_exchange_strong(expected, true)) {
+            return r;
+        }
+    }
+    EpochRecord* r = new EpochRecord();
+    r->in_use = true;
+    r->next = records.load();
+    while (!records.compare_exchange_weak(r->next, r)) {}
+    return r;
+}
+
+// Hands the record back when the thread exits, so thread-per-client
+// servers don't grow the list without bound.
+struct ThreadRecord {
+    EpochRecord* record = nullptr;
+    int depth = 0;
+    ~ThreadRecord() {
+        if (record) record->in_use.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local ThreadRecord thread_record;
+
+EpochGuard::EpochGuard() {
+    ThreadRecord& tr = thread_record;
+    if (tr.depth++ > 0) return; // Nested guard: the outer one already pins us
+    if (!tr.record) tr.record = acquire_record();
+    // seq_cst so the announcement is visible before any protected pointer is read
+    tr.record->epoch.store(global_epoch.load());
+}
+
+EpochGuard::~EpochGuard() {
+    ThreadRecord& tr = thread_record;
+    if (--tr.depth > 0) return;
+    tr.record->epoch.store(0, std::memory_order_release);
+}
+
+// The epoch can move on once every active reader has seen the current one.
+// Objects retired two epochs ago are then unreachable. Caller holds retire_mutex.
+static void try_advance_and_reclaim() {
+    uint64_t current = global_epoch.load();
+    for (EpochRecord* r = records.load(); r; r = r->next) {
+        uint64_t e = r->epoch.load();
+        if (e != 0 && e != current) return;
+    }
+    global_epoch.compare_exchange_strong(current, current + 1);
+    uint64_t now = global_epoch.load();
+
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); ++i) {
+        if (retired[i].epoch + 2 <= now) {
+            retired[i].deleter(retired[i].ptr);
+        } else {
+            retired[kept++] = retired[i];
+        }
+    }
+    retired.resize(kept);
+}
+
+void epoch_retire(void* ptr, EpochDeleter deleter) {
+    if (!ptr) return;
+    std::lock_guard<std::mutex> lock(retire_mutex);
+    retired.push_back({ptr, deleter, global_epoch.load()});
+    if (retired.size() >= EPOCH_RECLAIM_BATCH) try_advance_and_reclaim();
+}
@@ -0,0 +1,212 @@
+#include "graph_actor.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define ACTOR_MAX_BATCH 256 // Bounds how long the first op in a batch waits
+
+enum GraphOpType {
+    GRAPH_OP_RESET, GRAPH_OP_ADD, GRAPH_OP_REMOVE, GRAPH_OP_ADD_MANY, GRAPH_OP_REMOVE_MANY, GRAPH_OP_WINDOW
+};
+
+// A queued command. It lives on the submitting thread's stack, which stays
+// blocked until the owner marks it done.
+struct GraphOp {
+    std::atomic<GraphOp*> next{nullptr};
+    GraphOpType type;
+    Graph* graph;
+    Point point;
+    const Point* points = nullptr; // GRAPH_OP_*_MANY
+    size_t n = 0;       // Also GRAPH_OP_WINDOW's point limit
+    double seconds = 0; // GRAPH_OP_WINDOW
+    size_t count = 0;   // Result of GRAPH_OP_ADD, GRAPH_OP_WINDOW and GRAPH_OP_*_MANY
+    bool found = false; // Result of GRAPH_OP_REMOVE
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+    bool done = false;
+};
+
+// Intrusive multi-producer single-consumer queue (Vyukov). push() is one
+// atomic exchange; only the owner thread calls pop().
+class GraphOpQueue {
+public:
+    GraphOpQueue() : head(&stub), tail(&stub) {}
+
+    void push(GraphOp* op) {
+        op->next.store(nullptr, std::memory_order_relaxed);
+        GraphOp* prev = head.exchange(op);
+        prev->next.store(op, std::memory_order_release);
+    }
+
+    // Returns nullptr when empty, or while a producer is between its
+    // exchange and its link (the op shows up on the next call).
+    GraphOp* pop() {
+        GraphOp* t = tail;
+        GraphOp* next = t->next.load(std::memory_order_acquire);
+        if (t == &stub) {
+            if (!next) return nullptr;
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail = next;
+            return t;
+        }
+        if (t != head.load()) return nullptr;
+        push(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if (next) {
+            tail = next;
+            return t;
+        }
+        return nullptr;
+    }
+
+    // Consumer only. A producer that has exchanged head but not linked yet
+    // already makes the queue non-empty, so the owner never sleeps on it.
+    bool empty() const {
+        return tail == &stub && head.load() == &stub;
+    }
+
+private:
+    std::atomic<GraphOp*> head; // Producers
+    GraphOp* tail;              // Consumer only
+    GraphOp stub;
+};
+
+static GraphOpQueue queue;
+static std::atomic<bool> owner_sleeping(false);
+static std::mutex wake_mutex;
+static std::condition_variable wake_cond;
+
+static void apply(GraphWriteBatch& batch, GraphOp* op) {
+    switch (op->type) {
+    case GRAPH_OP_RESET: batch.reset(); break;
+    case GRAPH_OP_ADD: op->count = batch.add_point(op->point); break;
+    case GRAPH_OP_REMOVE: op->found = batch.remove_point(op->point); break;
+    case GRAPH_OP_ADD_MANY: op->count = batch.add_points(op->points, op->n); break;
+    case GRAPH_OP_REMOVE_MANY: op->count = batch.remove_points(op->points, op->n); break;
+    case GRAPH_OP_WINDOW: op->count = batch.set_window(op->n, op->seconds); break;
+    }
+}
+
+static void wait_for_work() {
+    for (int spin = 0; spin < 64; ++spin) {
+        if (!queue.empty()) return;
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    owner_sleeping = true;
+    // Producers check owner_sleeping after pushing, so either they see it
+    // set or we see their op here
+    wake_cond.wait(lock, []{ return !queue.empty(); });
+    owner_sleeping = false;
+}
+
+static void owner_thread() {
+    std::vector<GraphOp*> ops;
+    std::vector<std::pair<Graph*, GraphWriteBatch*>> batches;
+    while (true) {
+        wait_for_work();
+        GraphOp* op;
+        while (ops.size() < ACTOR_MAX_BATCH && (op = queue.pop()) != nullptr) ops.push_back(op);
+        if (ops.empty()) continue; // Producer mid-push; its op arrives next round
+
+        // One lock and one published snapshot per touched graph; order is
+        // preserved within a graph, which is all clients can observe
+        for (GraphOp* o : ops) {
+            GraphWriteBatch* batch = nullptr;
+            for (auto& b : batches) {
+                if (b.first == o->graph) batch = b.second;
+            }
+            if (!batch) {
+                batch = new GraphWriteBatch(*o->graph);
+                batches.push_back(std::make_pair(o->graph, batch));
+            }
+            apply(*batch, o);
+        }
+        for (auto& b : batches) delete b.second; // Publishes
+        batches.clear();
+
+        // Complete only after publishing, so a client's next CH sees its write
+        for (GraphOp* o : ops) {
+            std::lock_guard<std::mutex> lock(o->done_mutex);
+            o->done = true;
+            o->done_cond.notify_one();
+        }
+        ops.clear();
+    }
+}
+
+void start_graph_actor() {
+    std::thread(owner_thread).detach();
+}
+
+static void submit_and_wait(GraphOp& op) {
+    queue.push(&op);
+    if (owner_sleeping.load()) {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_cond.notify_one();
+    }
+    std::unique_lock<std::mutex> lock(op.done_mutex);
+    op.done_cond.wait(lock, [&op]{ return op.done; });
+}
+
+void actor_reset(Graph& graph) {
+    GraphOp op;
+    op.type = GRAPH_OP_RESET;
+    op.graph = &graph;
+    submit_and_wait(op);
+}
+
+size_t actor_add_point(Graph& graph, const Point& p) {
+    GraphOp op;
+    op.type = GRAPH_OP_ADD;
+    op.graph = &graph;
+    op.point = p;
+    submit_and_wait(op);
+    return op.count;
+}
+
+bool actor_remove_point(Graph& graph, const Point& p) {
+    GraphOp op;
+    op.type = GRAPH_OP_REMOVE;
+    op.graph = &graph;
+    op.point = p;
+    submit_and_wait(op);
+    return op.found;
+}
+
+size_t actor_add_points(Graph& graph, const Point* points, size_t n) {
+    GraphOp op;
+    op.type = GRAPH_OP_ADD_MANY;
+    op.graph = &graph;
+    op.points = points;
+    op.n = n;
+    submit_and_wait(op);
+    return op.count;
+}
+
+size_t actor_remove_points(Graph& graph, const Point* points, size_t n) {
+    GraphOp op;
+    op.type = GRAPH_OP_REMOVE_MANY;
+    op.graph = &graph;
+    op.points = points;
+    op.n = n;
+    submit_and_wait(op);
+    return op.count;
+}
+
+size_t actor_set_window(Graph& graph, size_t max_points, double max_seconds) {
+    GraphOp op;
+    op.type = GRAPH_OP_WINDOW;
+    op.graph = &graph;
+    op.n = max_points;
+    op.seconds = max_seconds;
+    submit_and_wait(op);
+    return op.count;
+}
@@ -0,0 +1,622 @@
+#include "graph_store.hpp"
+#include "epoch.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <unordered_map>
+
+#define GRAPH_SHARDS 16
+#define UNION_CACHE_SIZE 64 // Distinct graph sets; the cache is emptied when full
+
+// The name -> graph map is split into independently locked shards; lookups
+// only happen on Use/Newgraph, after which clients hold the graph directly.
+struct GraphShard {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Graph>> graphs;
+};
+
+static GraphShard shards[GRAPH_SHARDS];
+static GraphChangeHook change_hook = nullptr;
+
+std::shared_ptr<Graph> get_graph(const std::string& name) {
+    GraphShard& shard = shards[std::hash<std::string>()(name) % GRAPH_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    std::shared_ptr<Graph>& slot = shard.graphs[name];
+    if (!slot) {
+        slot = std::make_shared<Graph>();
+        slot->name = name;
+        slot->snapshot.store(new GraphSnapshot());
+    }
+    return slot;
+}
+
+std::shared_ptr<Graph> find_graph(const std::string& name) {
+    GraphShard& shard = shards[std::hash<std::string>()(name) % GRAPH_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.graphs.find(name);
+    return it == shard.graphs.end() ? nullptr : it->second;
+}
+
+void for_each_graph(const std::function<void(Graph&)>& fn) {
+    for (GraphShard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& entry : shard.graphs) fn(*entry.second);
+    }
+}
+
+void set_graph_change_hook(GraphChangeHook hook) {
+    change_hook = hook;
+}
+
+static int64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool window_expired(const GraphSnapshot* snap) {
+    return snap->expires_ns && steady_ns() >= snap->expires_ns;
+}
+
+static void graph_changed(Graph& graph) {
+    if (change_hook) change_hook(&graph);
+}
+
+static float cross(const Point& O, const Point& A, const Point& B) {
+    return (A.x - O.x) * (B.y - O.y) - (A.y - O.y) * (B.x - O.x);
+}
+
+// Hull vertices are counter-clockwise, so p is covered when it is never
+// strictly to the right of an edge.
+static bool hull_covers(const std::vector<Point>& hull, const Point& p) {
+    if (hull.size() < 3) return false;
+    for (size_t i = 0; i < hull.size(); ++i) {
+        if (cross(hull[i], hull[(i + 1) % hull.size()], p) < 0) return false;
+    }
+    return true;
+}
+
+static bool is_hull_vertex(const std::vector<Point>& hull, const Point& p) {
+    return std::any_of(hull.begin(), hull.end(),
+        [&p](const Point& q) { return q.x == p.x && q.y == p.y; });
+}
+
+static void set_hull(GraphSnapshot* snap, std::vector<Point> candidates) {
+    if (snap->point_count < 3 || candidates.size() < 3) {
+        snap->hull = candidates;
+        snap->hull_area = 0.0f;
+    } else {
+        MetricsTimer timer(HIST_CONVEX_HULL);
+        snap->hull = convex_hull(candidates);
+        snap->hull_area = convex_hull_area(snap->hull);
+    }
+    snap->hull_valid = true;
+    snap->geometry.reset();
+}
+
+// Uncontended acquisitions cost one try_lock and are not recorded
+static std::unique_lock<std::mutex> lock_graph(Graph& graph) {
+    std::unique_lock<std::mutex> lock(graph.mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        MetricsTimer timer(HIST_LOCK_WAIT);
+        lock.lock();
+    }
+    return lock;
+}
+
+// Caller holds graph.mutex, so the current snapshot can't be retired under us.
+static void publish(Graph& graph, GraphSnapshot* next) {
+    const GraphSnapshot* prev = graph.snapshot.exchange(next);
+    epoch_retire(prev);
+}
+
+GraphWriteBatch::GraphWriteBatch(Graph& graph)
+    : graph(graph), lock(lock_graph(graph)), next(new GraphSnapshot(*graph.snapshot.load())) {}
+
+GraphWriteBatch::~GraphWriteBatch() {
+    if (!modified) {
+        delete next;
+        return;
+    }
+    publish(graph, next);
+    lock.unlock();
+    graph_changed(graph);
+}
+
+void GraphWriteBatch::reset() {
+    graph.points.clear();
+    ++graph.rewrites;
+    if (graph.window) {
+        graph.window->hull.clear();
+        graph.window->arrival_ns.clear();
+    }
+    *next = GraphSnapshot();
+    next->version = ++graph.version;
+    modified = true;
+}
+
+size_t GraphWriteBatch::add_point(const Point& p) {
+    if (graph.window) {
+        window_add(&p, 1);
+        return next->point_count;
+    }
+    graph.points.push_back(p);
+    next->version = ++graph.version;
+    next->point_count = graph.points.size();
+    if (next->hull_valid && !hull_covers(next->hull, p)) {
+        // hull(S + p) == hull(hull(S) + p): O(h log h) instead of O(n log n)
+        std::vector<Point> candidates = next->hull;
+        candidates.push_back(p);
+        set_hull(next, candidates);
+    }
+    modified = true;
+    return next->point_count;
+}
+
+bool GraphWriteBatch::remove_point(const Point& p) {
+    if (graph.window) return window_remove(&p, 1) == 1;
+    auto it = std::find_if(graph.points.begin(), graph.points.end(),
+        [&p](const Point& q) { return q.x == p.x && q.y == p.y; });
+    if (it == graph.points.end()) return false;
+    graph.points.erase(it);
+    ++graph.rewrites;
+    next->version = ++graph.version;
+    next->point_count = graph.points.size();
+    if (next->hull_valid && is_hull_vertex(next->hull, p)) {
+        next->hull_valid = false; // Rebuilt lazily by the next reader
+        next->hull.clear();
+        next->hull_area = 0.0f;
+        next->geometry.reset();
+    }
+    modified = true;
+    return true;
+}
+
+size_t GraphWriteBatch::add_points(const Point* points, size_t n) {
+    if (n == 0) return next->point_count;
+    if (graph.window) {
+        window_add(points, n);
+        return next->point_count;
+    }
+    // One range insert: at most one reallocation, and still geometric growth
+    graph.points.insert(graph.points.end(), points, points + n);
+    std::vector<Point> candidates;
+    bool grow_hull = next->hull_valid;
+    if (grow_hull) candidates = next->hull;
+    for (size_t i = 0; i < n; ++i) {
+        if (grow_hull && !hull_covers(next->hull, points[i])) candidates.push_back(points[i]);
+    }
+    next->version = ++graph.version;
+    next->point_count = graph.points.size();
+    // Same identity as add_point, applied once for the whole run
+    if (grow_hull && candidates.size() > next->hull.size()) set_hull(next, candidates);
+    modified = true;
+    return next->point_count;
+}
+
+size_t GraphWriteBatch::remove_points(const Point* points, size_t n) {
+    if (n == 0) return 0;
+    if (graph.window) return window_remove(points, n);
+    std::vector<Point> targets(points, points + n);
+    std::sort(targets.begin(), targets.end());
+    std::vector<bool> taken(n, false);
+    size_t removed = 0;
+    bool hull_vertex_removed = false;
+    auto keep = graph.points.begin();
+    for (auto it = graph.points.begin(); it != graph.points.end(); ++it) {
+        // First target equal to *it that hasn't removed a point yet
+        size_t i = std::lower_bound(targets.begin(), targets.end(), *it) - targets.begin();
+        while (i < n && !(*it < targets[i]) && taken[i]) ++i;
+        if (i < n && !(*it < targets[i])) {
+            taken[i] = true;
+            ++removed;
+            if (next->hull_valid && is_hull_vertex(next->hull, *it)) hull_vertex_removed = true;
+            continue;
+        }
+        *keep++ = *it;
+    }
+    if (removed == 0) return 0;
+    graph.points.erase(keep, graph.points.end());
+    ++graph.rewrites;
+    next->version = ++graph.version;
+    next->point_count = graph.points.size();
+    if (hull_vertex_removed) {
+        next->hull_valid = false; // Rebuilt lazily by the next reader
+        next->hull.clear();
+        next->hull_area = 0.0f;
+        next->geometry.reset();
+    }
+    modified = true;
+    return removed;
+}
+
+// Publishes the window's size and hull. The hull is rebuilt from the
+// vertices of the window's two halves, O(h log h), and only when one of
+// them changed; tiny windows are always rebuilt so duplicates come and go
+// the same way they do for plain graphs.
+void GraphWriteBatch::window_publish(bool hull_changed) {
+    GraphWindow& window = *graph.window;
+    next->version = ++graph.version;
+    next->point_count = window.hull.size();
+    next->expires_ns = 0;
+    if (window.max_seconds > 0 && !window.arrival_ns.empty())
+        next->expires_ns = window.arrival_ns.front() + static_cast<int64_t>(window.max_seconds * 1e9);
+    if (hull_changed || next->point_count < 4 || !next->hull_valid) {
+        std::vector<Point> candidates = window.hull.hull_candidates();
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end(),
+            [](const Point& a, const Point& b) { return a.x == b.x && a.y == b.y; }), candidates.end());
+        set_hull(next, candidates);
+    }
+    modified = true;
+}
+
+// Pops points beyond the count limit or older than the age limit; returns
+// how many
+size_t GraphWriteBatch::window_expire(int64_t now, bool& hull_changed) {
+    GraphWindow& window = *graph.window;
+    size_t expired = 0;
+    while (window.max_points && window.hull.size() > window.max_points) {
+        hull_changed |= window.hull.pop();
+        window.arrival_ns.pop_front();
+        ++expired;
+    }
+    if (window.max_seconds > 0) {
+        int64_t cutoff = now - static_cast<int64_t>(window.max_seconds * 1e9);
+        while (!window.arrival_ns.empty() && window.arrival_ns.front() <= cutoff) {
+            hull_changed |= window.hull.pop();
+            window.arrival_ns.pop_front();
+            ++expired;
+        }
+    }
+    return expired;
+}
+
+void GraphWriteBatch::window_add(const Point* points, size_t n) {
+    GraphWindow& window = *graph.window;
+    int64_t now = steady_ns();
+    bool hull_changed = false;
+    for (size_t i = 0; i < n; ++i) {
+        hull_changed |= window.hull.push(points[i]);
+        window.arrival_ns.push_back(now);
+        // Expiring as we go keeps a long run from growing past the window
+        if (window.max_points && window.hull.size() > window.max_points) {
+            hull_changed |= window.hull.pop();
+            window.arrival_ns.pop_front();
+        }
+    }
+    window_expire(now, hull_changed);
+    window_publish(hull_changed);
+}
+
+// A window is a FIFO, so removing from the middle rebuilds it: O(n log n),
+// keeping each survivor's arrival time
+size_t GraphWriteBatch::window_remove(const Point* points, size_t n) {
+    GraphWindow& window = *graph.window;
+    std::vector<Point> current;
+    window.hull.points(current);
+    std::vector<Point> targets(points, points + n);
+    std::sort(targets.begin(), targets.end());
+    std::vector<bool> taken(n, false);
+    std::vector<bool> gone(current.size(), false);
+    size_t removed = 0;
+    for (size_t j = 0; j < current.size(); ++j) {
+        size_t i = std::lower_bound(targets.begin(), targets.end(), current[j]) - targets.begin();
+        while (i < n && !(current[j] < targets[i]) && taken[i]) ++i;
+        if (i < n && !(current[j] < targets[i])) {
+            taken[i] = true;
+            gone[j] = true;
+            ++removed;
+        }
+    }
+    if (removed == 0) return 0;
+    std::deque<int64_t> arrivals;
+    window.hull.clear();
+    for (size_t j = 0; j < current.size(); ++j) {
+        if (gone[j]) continue;
+        window.hull.push(current[j]);
+        arrivals.push_back(window.arrival_ns[j]);
+    }
+    window.arrival_ns.swap(arrivals);
+    window_publish(true);
+    return removed;
+}
+
+size_t GraphWriteBatch::set_window(size_t max_points, double max_seconds) {
+    ++graph.rewrites;
+    if (max_points == 0 && max_seconds <= 0) {
+        if (!graph.window) return next->point_count;
+        graph.window->hull.points(graph.points);
+        graph.window.reset();
+        next->version = ++graph.version;
+        next->expires_ns = 0;
+        modified = true;
+        return next->point_count;
+    }
+    int64_t now = steady_ns();
+    bool hull_changed = false;
+    if (!graph.window) {
+        graph.window.reset(new GraphWindow());
+        for (const Point& p : graph.points) {
+            graph.window->hull.push(p);
+            graph.window->arrival_ns.push_back(now);
+        }
+        std::vector<Point>().swap(graph.points);
+        hull_changed = true;
+    }
+    graph.window->max_points = max_points;
+    graph.window->max_seconds = max_seconds;
+    window_expire(now, hull_changed);
+    window_publish(hull_changed);
+    return next->point_count;
+}
+
+void GraphWriteBatch::expire() {
+    if (!graph.window) return;
+    bool hull_changed = false;
+    if (window_expire(steady_ns(), hull_changed) == 0) return;
+    window_publish(hull_changed);
+}
+
+void graph_reset(Graph& graph) {
+    GraphWriteBatch batch(graph);
+    batch.reset();
+}
+
+size_t graph_add_point(Graph& graph, const Point& p) {
+    GraphWriteBatch batch(graph);
+    return batch.add_point(p);
+}
+
+bool graph_remove_point(Graph& graph, const Point& p) {
+    GraphWriteBatch batch(graph);
+    return batch.remove_point(p);
+}
+
+size_t graph_add_points(Graph& graph, const Point* points, size_t n) {
+    GraphWriteBatch batch(graph);
+    return batch.add_points(points, n);
+}
+
+size_t graph_remove_points(Graph& graph, const Point* points, size_t n) {
+    GraphWriteBatch batch(graph);
+    return batch.remove_points(points, n);
+}
+
+size_t graph_set_window(Graph& graph, size_t max_points, double max_seconds) {
+    GraphWriteBatch batch(graph);
+    return batch.set_window(max_points, max_seconds);
+}
+
+static void graph_expire(Graph& graph) {
+    GraphWriteBatch batch(graph);
+    batch.expire();
+}
+
+// A hull rebuild shared by every reader that finds the hull stale while it
+// runs. Its input is taken under the graph lock, but the O(n log n) part
+// runs outside it: writers carry on, and readers that arrive meanwhile wait
+// for it instead of queueing to compute the same hull. Points appended in
+// the meantime are merged in when it lands.
+struct HullFlight {
+    uint64_t rewrites = 0; // Graph::rewrites and point count when it started
+    size_t point_count = 0;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done = false;
+};
+
+static void land(Graph& graph, HullFlight& flight) {
+    if (graph.hull_flight.get() == &flight) graph.hull_flight.reset();
+    {
+        std::lock_guard<std::mutex> guard(flight.mutex);
+        flight.done = true;
+    }
+    flight.cond.notify_all();
+}
+
+// Caller holds lock and the published hull is invalid. Joins the rebuild
+// under way, if nothing but appends happened since it started, or starts
+// one; either way the hull is published unless a writer did more than
+// append meanwhile. lock is released while the hull is built and held
+// again on return.
+static void rebuild_shared(Graph& graph, std::unique_lock<std::mutex>& lock) {
+    std::shared_ptr<HullFlight> flight = graph.hull_flight;
+    if (flight && flight->rewrites == graph.rewrites) {
+        metrics_add(CTR_HULL_REBUILD_WAITS);
+        lock.unlock();
+        {
+            std::unique_lock<std::mutex> wait(flight->mutex);
+            flight->cond.wait(wait, [&flight] { return flight->done; });
+        }
+        lock.lock();
+        return;
+    }
+
+    flight = std::make_shared<HullFlight>();
+    flight->rewrites = graph.rewrites;
+    flight->point_count = graph.snapshot.load()->point_count;
+    graph.hull_flight = flight;
+    // Copying the points is cheap next to sorting them
+    std::vector<Point> points = graph.points;
+    GraphSnapshot built;
+    built.point_count = flight->point_count;
+    lock.unlock();
+    try {
+        set_hull(&built, std::move(points));
+    } catch (...) {
+        lock.lock();
+        land(graph, *flight);
+        throw;
+    }
+    lock.lock();
+
+    const GraphSnapshot* snap = graph.snapshot.load();
+    if (!snap->hull_valid && graph.rewrites == flight->rewrites) {
+        GraphSnapshot* next = new GraphSnapshot(*snap);
+        if (graph.points.size() == flight->point_count) {
+            next->hull = std::move(built.hull);
+            next->hull_area = built.hull_area;
+            next->hull_valid = true;
+            next->geometry.reset();
+        } else {
+            // Same identity as add_points: hull(S + new) == hull(hull(S) + new)
+            std::vector<Point> candidates = std::move(built.hull);
+            candidates.insert(candidates.end(), graph.points.begin() + flight->point_count, graph.points.end());
+            set_hull(next, candidates);
+        }
+        publish(graph, next);
+    }
+    land(graph, *flight);
+}
+
+// Slow path after a hull vertex was removed or the hull changed since the
+// last query: rebuild what is missing and republish under the same version.
+// Caller holds lock, which a shared rebuild releases while it runs.
+static const GraphSnapshot* complete_snapshot(Graph& graph, std::unique_lock<std::mutex>& lock, bool need_geometry) {
+    if (!graph.snapshot.load()->hull_valid) rebuild_shared(graph, lock);
+    const GraphSnapshot* prev = graph.snapshot.load();
+    // Still stale only if a writer removed points during the rebuild; build
+    // under the lock this time so a reader can't be outrun indefinitely
+    bool need_hull = !prev->hull_valid;
+    need_geometry = need_geometry && (need_hull || !prev->geometry);
+    if (!need_hull && !need_geometry) return prev;
+    GraphSnapshot* next = new GraphSnapshot(*prev);
+    if (need_hull) set_hull(next, graph.points);
+    if (need_geometry) {
+        std::shared_ptr<HullGeometry> geometry = std::make_shared<HullGeometry>();
+        hull_geometry(next->hull, *geometry);
+        next->geometry = geometry;
+    }
+    publish(graph, next);
+    return next;
+}
+
+static bool rebuild_hull(Graph& graph, float& area) {
+    std::unique_lock<std::mutex> lock = lock_graph(graph);
+    if (graph.snapshot.load()->point_count < 3) return false;
+    area = complete_snapshot(graph, lock, false)->hull_area;
+    return true;
+}
+
+bool graph_hull_area(Graph& graph, float& area) {
+    bool expired;
+    {
+        EpochGuard guard;
+        const GraphSnapshot* snap = graph.snapshot.load(std::memory_order_acquire);
+        expired = window_expired(snap);
+        if (!expired && snap->point_count < 3) return false;
+        if (!expired && snap->hull_valid) {
+            area = snap->hull_area;
+            return true;
+        }
+    }
+    if (expired) graph_expire(graph);
+    return rebuild_hull(graph, area);
+}
+
+bool graph_hull_query(Graph& graph, const std::function<void(const GraphSnapshot&)>& query) {
+    bool expired;
+    {
+        EpochGuard guard;
+        const GraphSnapshot* snap = graph.snapshot.load(std::memory_order_acquire);
+        expired = window_expired(snap);
+        if (!expired && snap->point_count < 3) return false;
+        if (!expired && snap->hull_valid && snap->geometry) {
+            if (snap->hull.size() < 3) return false;
+            query(*snap);
+            return true;
+        }
+    }
+    if (expired) graph_expire(graph);
+    // Holding the lock keeps the snapshot from being retired under query
+    std::unique_lock<std::mutex> lock = lock_graph(graph);
+    if (graph.snapshot.load()->point_count < 3) return false;
+    const GraphSnapshot* snap = complete_snapshot(graph, lock, true);
+    if (snap->hull.size() < 3) return false; // All points collinear
+    query(*snap);
+    return true;
+}
+
+// Version of the graph's current hull, after bringing it up to date, and
+// optionally a copy of it with the point count
+static uint64_t current_hull(Graph& graph, std::vector<Point>* hull, size_t* point_count) {
+    while (true) {
+        bool expired;
+        {
+            EpochGuard guard;
+            const GraphSnapshot* snap = graph.snapshot.load(std::memory_order_acquire);
+            expired = window_expired(snap);
+            if (!expired && snap->hull_valid) {
+                if (hull) *hull = snap->hull;
+                if (point_count) *point_count = snap->point_count;
+                return snap->version;
+            }
+        }
+        if (expired) {
+            graph_expire(graph);
+        } else {
+            std::unique_lock<std::mutex> lock = lock_graph(graph);
+            complete_snapshot(graph, lock, false);
+        }
+    }
+}
+
+// Last union computed for each set of graphs (sorted), with the graph
+// versions it was computed from
+struct UnionEntry {
+    std::vector<uint64_t> versions;
+    std::shared_ptr<const GraphUnion> result;
+};
+
+static std::mutex union_mutex;
+static std::map<std::vector<Graph*>, UnionEntry> union_cache;
+
+std::shared_ptr<const GraphUnion> graph_union(const std::vector<std::shared_ptr<Graph>>& graphs) {
+    std::vector<Graph*> parts;
+    for (const std::shared_ptr<Graph>& graph : graphs) parts.push_back(graph.get());
+    std::sort(parts.begin(), parts.end());
+    parts.erase(std::unique(parts.begin(), parts.end()), parts.end());
+    std::vector<uint64_t> versions;
+    for (Graph* graph : parts) versions.push_back(current_hull(*graph, nullptr, nullptr));
+    {
+        std::lock_guard<std::mutex> lock(union_mutex);
+        auto it = union_cache.find(parts);
+        if (it != union_cache.end() && it->second.versions == versions) return it->second.result;
+    }
+
+    // A graph may change between the two passes, so the result is filed
+    // under the versions its hulls actually came from
+    std::shared_ptr<GraphUnion> result = std::make_shared<GraphUnion>();
+    std::vector<Point> candidates, hull;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        size_t count;
+        versions[i] = current_hull(*parts[i], &hull, &count);
+        candidates.insert(candidates.end(), hull.begin(), hull.end());
+        result->point_count += count;
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end(),
+        [](const Point& a, const Point& b) { return a.x == b.x && a.y == b.y; }), candidates.end());
+    if (result->point_count < 3 || candidates.size() < 3) {
+        result->hull = candidates;
+    } else {
+        MetricsTimer timer(HIST_CONVEX_HULL);
+        result->hull = convex_hull(candidates);
+        result->hull_area = convex_hull_area(result->hull);
+    }
+
+    std::lock_guard<std::mutex> lock(union_mutex);
+    if (union_cache.size() >= UNION_CACHE_SIZE && !union_cache.count(parts)) union_cache.clear();
+    union_cache[parts] = UnionEntry{versions, result};
+    return result;
+}
+
+void graph_sizes(Graph& graph, size_t& points, size_t& hull_vertices) {
+    EpochGuard guard;
+    const GraphSnapshot* snap = graph.snapshot.load(std::memory_order_acquire);
+    points = snap->point_count;
+    hull_vertices = snap->hull_valid ? snap->hull.size() : 0;
+}
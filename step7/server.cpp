@@ -1,5 +1,10 @@
 #include "server.hpp"
 #include "convex_hull.hpp"
+#include "graph_actor.hpp"
+#include "metrics.hpp"
+#include "format.hpp"
+#include "parse.hpp"
+#include "listener.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -7,210 +12,503 @@
 #include <cstring>
 #include <vector>
 #include <string>
-#include <sstream>
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <system_error>
+#include <cerrno>
+#include <fcntl.h>
 
-#define BACKLOG 10
 #define BUFSIZE 1024
 
-static std::vector<Point> points;
-static std::map<int, int> points_to_read;
-static std::mutex points_mutex; // Protects points and points_to_read
+static std::atomic<int> reserve_fd(-1); // Spare descriptor released to shed connections on EMFILE
 
-std::string handle_command(const std::string& cmdline) {
-    std::istringstream iss(cmdline);
-    std::string cmd;
-    iss >> cmd;
-    std::ostringstream response;
+// accept4() that survives descriptor exhaustion: on EMFILE/ENFILE the reserve
+// fd is released so the pending connection can be accepted and closed at once,
+// instead of spinning on accept() or leaving the client stuck in the backlog.
+// Returns -1 with errno set when nothing was handed out.
+static int accept_client(int listener, int flags) {
+    while (true) {
+        int fd = accept4(listener, nullptr, nullptr, flags);
+        if (fd >= 0) return fd;
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        int spare; // Taken by one accept thread at a time
+        if ((errno == EMFILE || errno == ENFILE) && (spare = reserve_fd.exchange(-1)) >= 0) {
+            close(spare);
+            int shed = accept(listener, nullptr, nullptr);
+            if (shed >= 0) close(shed);
+            reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            std::cerr << "accept: out of file descriptors, connection shed\n";
+            errno = EMFILE;
+        }
+        return -1;
+    }
+}
+
+static bool actor_mode = false; // Mutations go through the graph owner thread
+static std::atomic<int> client_threads(0);
+
+static void reset_graph(Graph& graph) {
+    if (actor_mode) actor_reset(graph);
+    else graph_reset(graph);
+}
+
+static size_t add_point(Graph& graph, const Point& p) {
+    return actor_mode ? actor_add_point(graph, p) : graph_add_point(graph, p);
+}
+
+static bool remove_point(Graph& graph, const Point& p) {
+    return actor_mode ? actor_remove_point(graph, p) : graph_remove_point(graph, p);
+}
+
+static size_t add_points(Graph& graph, const std::vector<Point>& points) {
+    return actor_mode ? actor_add_points(graph, points.data(), points.size())
+                      : graph_add_points(graph, points.data(), points.size());
+}
+
+static size_t remove_points(Graph& graph, const std::vector<Point>& points) {
+    return actor_mode ? actor_remove_points(graph, points.data(), points.size())
+                      : graph_remove_points(graph, points.data(), points.size());
+}
+
+static size_t set_window(Graph& graph, size_t max_points, double max_seconds) {
+    return actor_mode ? actor_set_window(graph, max_points, max_seconds)
+                      : graph_set_window(graph, max_points, max_seconds);
+}
+
+// Applies the point lines staged since the last commit as one mutation;
+// returns the graph's point count afterwards
+static size_t commit_staged(ClientSession& session) {
+    size_t count = add_points(*session.graph, session.staged);
+    session.staged.clear();
+    return count;
+}
+
+// Inside/Extreme/Tangents X,Y and Perimeter/Diameter/MinRect, answered from
+// the published hull and its cached geometry; none touches the point set
+static void hull_query(Graph& graph, const CommandLine& cmd, std::string& out) {
+    bool takes_point = cmd.id == CMD_INSIDE || cmd.id == CMD_EXTREME || cmd.id == CMD_TANGENTS;
+    Point p = {0.0f, 0.0f};
+    if (takes_point && (cmd.argc < 1 || !parse_point(cmd.args[0], p) ||
+                        (cmd.id == CMD_EXTREME && p.x == 0.0f && p.y == 0.0f))) {
+        out += "Invalid usage. Example: ";
+        out += cmd.name;
+        out += " 1,2\n";
+        return;
+    }
+    bool answered = graph_hull_query(graph, [&](const GraphSnapshot& snap) {
+        const std::vector<Point>& hull = snap.hull;
+        const HullGeometry& geo = *snap.geometry;
+        switch (cmd.id) {
+        case CMD_INSIDE: {
+            HullSide side = hull_locate(hull, p);
+            out += "Point ";
+            append_point(out, p.x, p.y);
+            out += side == HULL_INSIDE ? " is inside the hull.\n"
+                 : side == HULL_BOUNDARY ? " is on the hull boundary.\n" : " is outside the hull.\n";
+            break;
+        }
+        case CMD_EXTREME: {
+            const Point& v = hull[hull_extreme(hull, geo, p.x, p.y)];
+            out += "Extreme vertex toward ";
+            append_point(out, p.x, p.y);
+            out += ": ";
+            append_point(out, v.x, v.y);
+            out += '\n';
+            break;
+        }
+        case CMD_TANGENTS: {
+            size_t first, second;
+            out += "Point ";
+            append_point(out, p.x, p.y);
+            if (!hull_tangents(hull, geo, p, first, second)) {
+                out += " is not outside the hull.\n";
+                break;
+            }
+            out += " touches the hull at ";
+            append_point(out, hull[first].x, hull[first].y);
+            out += " and ";
+            append_point(out, hull[second].x, hull[second].y);
+            out += '\n';
+            break;
+        }
+        case CMD_PERIMETER:
+            out += "Convex hull perimeter: ";
+            append_float(out, geo.perimeter);
+            out += '\n';
+            break;
+        case CMD_DIAMETER:
+            out += "Convex hull diameter: ";
+            append_float(out, geo.diameter);
+            out += " from ";
+            append_point(out, geo.diameter_ends[0].x, geo.diameter_ends[0].y);
+            out += " to ";
+            append_point(out, geo.diameter_ends[1].x, geo.diameter_ends[1].y);
+            out += '\n';
+            break;
+        default:
+            out += "Minimum bounding rectangle area: ";
+            append_float(out, geo.min_rect_area);
+            out += ", corners";
+            for (const Point& c : geo.min_rect) {
+                out += ' ';
+                append_point(out, c.x, c.y);
+            }
+            out += '\n';
+            break;
+        }
+    });
+    if (!answered) out += "Need at least 3 points not all on one line.\n";
+}
 
-    std::lock_guard<std::mutex> lock(points_mutex);
+// Classify X,Y ...: one bit per point, 1 for inside or on the hull
+static void classify_points(Graph& graph, const CommandLine& cmd, std::string& out) {
+    std::vector<Point> points;
+    if (!parse_points(cmd.rest, points)) {
+        out += "Invalid usage. Example: Classify 1,2 3,4\n";
+        return;
+    }
+    std::vector<uint8_t> inside(points.size());
+    bool answered = graph_hull_query(graph, [&](const GraphSnapshot& snap) {
+        hull_classify(snap.geometry->fan, points.data(), points.size(), inside.data());
+    });
+    if (!answered) {
+        out += "Need at least 3 points not all on one line.\n";
+        return;
+    }
+    append_int(out, std::count(inside.begin(), inside.end(), 1));
+    out += " of ";
+    append_int(out, points.size());
+    out += " points inside: ";
+    for (uint8_t bit : inside) out += bit ? '1' : '0';
+    out += '\n';
+}
 
-    if (cmd == "Newgraph") {
+// Union G1 G2 ...: hull area of the named graphs' points taken together
+static void union_hull(const CommandLine& cmd, std::string& out) {
+    std::vector<std::shared_ptr<Graph>> graphs;
+    std::string_view rest = cmd.rest, name;
+    while (next_token(rest, name)) {
+        std::shared_ptr<Graph> graph = find_graph(std::string(name));
+        if (!graph) {
+            out += "No graph named ";
+            out += name;
+            out += ".\n";
+            return;
+        }
+        graphs.push_back(graph);
+    }
+    if (graphs.empty()) {
+        out += "Invalid usage. Example: Union graph1 graph2\n";
+        return;
+    }
+    std::shared_ptr<const GraphUnion> result = graph_union(graphs);
+    if (result->point_count < 3) {
+        out += "Need at least 3 points to compute convex hull.\n";
+        return;
+    }
+    out += "Union convex hull area: ";
+    append_float(out, result->hull_area);
+    out += " (";
+    append_int(out, result->hull.size());
+    out += " vertices, ";
+    append_int(out, result->point_count);
+    out += " points)\n";
+}
+
+static Histogram command_histogram(CommandId id) {
+    switch (id) {
+    case CMD_NEWGRAPH: return HIST_CMD_NEWGRAPH;
+    case CMD_NEWPOINT:
+    case CMD_NEWPOINTS: return HIST_CMD_NEWPOINT;
+    case CMD_REMOVEPOINT:
+    case CMD_REMOVEPOINTS: return HIST_CMD_REMOVEPOINT;
+    case CMD_CH: return HIST_CMD_CH;
+    default: return HIST_CMD_OTHER;
+    }
+}
+
+void handle_command(ClientSession& session, std::string_view cmdline, std::string& out) {
+    CommandLine cmd;
+    parse_command(cmdline, cmd);
+    MetricsTimer timer(command_histogram(cmd.id));
+    AdmissionSlot slot(cmd.id != CMD_STATS); // STATS must work under overload
+    if (slot.rejected()) {
+        out += "BUSY Server overloaded, try again later.\n";
+        return;
+    }
+
+    if (!session.graph) session.graph = get_graph(DEFAULT_GRAPH);
+
+    switch (cmd.id) {
+    case CMD_USE: {
+        if (cmd.argc < 1) {
+            out += "Invalid usage. Example: Use mygraph\n";
+            return;
+        }
+        session.graph = get_graph(std::string(cmd.args[0]));
+        session.points_to_read = 0;
+        out += "Using graph ";
+        out += cmd.args[0];
+        out += ".\n";
+        break;
+    }
+    case CMD_NEWGRAPH: {
+        // Newgraph N resets the current graph; Newgraph <name> N switches first
+        bool named = cmd.argc >= 2;
         int n;
-        if (!(iss >> n) || n < 1) {
-            response << "Invalid usage. Example: Newgraph 4\n";
-            return response.str();
-        }
-        points.clear();
-        response << "OK. Send " << n << " points (x,y per line):\n";
-        return response.str();
-    } else if (cmd == "CH") {
+        if (cmd.argc < 1 || !parse_count(cmd.args[named ? 1 : 0], n)) {
+            out += "Invalid usage. Example: Newgraph 4 or Newgraph mygraph 4\n";
+            return;
+        }
+        if (named) session.graph = get_graph(std::string(cmd.args[0]));
+        reset_graph(*session.graph);
+        session.points_to_read = n;
+        out += "OK. Send ";
+        append_int(out, n);
+        out += " points (x,y per line):\n";
+        break;
+    }
+    case CMD_CH:
         try {
-            if (points.size() < 3) {
-                response << "Need at least 3 points to compute convex hull.\n";
+            float area;
+            if (!graph_hull_area(*session.graph, area)) {
+                out += "Need at least 3 points to compute convex hull.\n";
             } else {
-                std::vector<Point> hull = convex_hull(points);
-                float area = convex_hull_area(hull);
-                response << "Convex hull area: " << area << "\n";
+                out += "Convex hull area: ";
+                append_float(out, area);
+                out += '\n';
             }
         } catch (const std::exception& ex) {
-            response << "Error: " << ex.what() << "\n";
-        }
-        return response.str();
-    } else if (cmd == "Newpoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
-            return response.str();
-        }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Newpoint 1,2\n";
-        } else {
-            points.push_back({x, y});
-            response << "Point (" << x << "," << y << ") added.\n";
-        }
-        return response.str();
-    } else if (cmd == "Removepoint") {
-        std::string coords;
-        if (!(iss >> coords)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
-            return response.str();
-        }
-        std::replace(coords.begin(), coords.end(), ',', ' ');
-        std::istringstream coord_iss(coords);
-        float x, y;
-        if (!(coord_iss >> x >> y)) {
-            response << "Invalid usage. Example: Removepoint 1,2\n";
-        } else {
-            auto it = std::find_if(points.begin(), points.end(),
-                [x, y](const Point& p) { return p.x == x && p.y == y; });
-            if (it != points.end()) {
-                points.erase(it);
-                response << "Point (" << x << "," << y << ") removed.\n";
+            out += "Error: ";
+            out += ex.what();
+            out += '\n';
+        }
+        break;
+    case CMD_NEWPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Newpoint 1,2\n";
+            return;
+        }
+        add_point(*session.graph, p);
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        out += " added.\n";
+        break;
+    }
+    case CMD_REMOVEPOINT: {
+        Point p;
+        if (cmd.argc < 1 || !parse_point(cmd.args[0], p)) {
+            out += "Invalid usage. Example: Removepoint 1,2\n";
+            return;
+        }
+        out += "Point ";
+        append_point(out, p.x, p.y);
+        out += remove_point(*session.graph, p) ? " removed.\n" : " not found.\n";
+        break;
+    }
+    case CMD_INSIDE:
+    case CMD_EXTREME:
+    case CMD_TANGENTS:
+    case CMD_PERIMETER:
+    case CMD_DIAMETER:
+    case CMD_MINRECT:
+        hull_query(*session.graph, cmd, out);
+        break;
+    case CMD_CLASSIFY:
+        classify_points(*session.graph, cmd, out);
+        break;
+    case CMD_UNION:
+        union_hull(cmd, out);
+        break;
+    case CMD_NEWPOINTS: {
+        // All or nothing: one malformed token rejects the whole line
+        std::vector<Point> points;
+        if (!parse_points(cmd.rest, points)) {
+            out += "Invalid usage. Example: Newpoints 1,2 3,4\n";
+            return;
+        }
+        size_t count = add_points(*session.graph, points);
+        append_int(out, points.size());
+        out += " points added. Graph has ";
+        append_int(out, count);
+        out += " points.\n";
+        break;
+    }
+    case CMD_REMOVEPOINTS: {
+        std::vector<Point> points;
+        if (!parse_points(cmd.rest, points)) {
+            out += "Invalid usage. Example: Removepoints 1,2 3,4\n";
+            return;
+        }
+        append_int(out, remove_points(*session.graph, points));
+        out += " of ";
+        append_int(out, points.size());
+        out += " points removed.\n";
+        break;
+    }
+    case CMD_WINDOW: {
+        // Window N, Window Ts, Window N Ts: keep only the newest N points
+        // and/or those younger than T seconds. Window off: keep everything.
+        int max_points = 0;
+        float max_seconds = 0.0f;
+        bool off = cmd.argc == 1 && cmd.args[0] == "off";
+        bool valid = off || cmd.argc >= 1;
+        for (int i = 0; i < cmd.argc && i < 2 && valid && !off; ++i) {
+            std::string_view arg = cmd.args[i];
+            if (arg.size() > 1 && arg.back() == 's') {
+                valid = max_seconds == 0.0f && parse_float(arg.substr(0, arg.size() - 1), max_seconds) &&
+                        max_seconds > 0.0f;
             } else {
-                response << "Point (" << x << "," << y << ") not found.\n";
+                valid = max_points == 0 && parse_count(arg, max_points);
             }
         }
-        return response.str();
-    } else {
-        response << "Unknown command.\n";
-        return response.str();
+        if (!valid) {
+            out += "Invalid usage. Example: Window 1000, Window 30s, Window 1000 30s or Window off\n";
+            return;
+        }
+        size_t count = set_window(*session.graph, max_points, max_seconds);
+        out += off ? "Window off. Graph has " : "Window set. Graph has ";
+        append_int(out, count);
+        out += " points.\n";
+        break;
+    }
+    case CMD_STATS:
+        out += metrics_report();
+        break;
+    default:
+        metrics_add(CTR_UNKNOWN_COMMANDS);
+        out += "Unknown command.\n";
+        break;
     }
 }
 
+// At the connection cap: say why instead of leaving the client in the backlog
+static void reject_client(int client_fd) {
+    static const char busy[] = "BUSY Too many connections, try again later.\n";
+    send(client_fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(client_fd);
+    metrics_add(CTR_CONNECTIONS_SHED);
+}
+
 void client_thread(int client_fd) {
     char buf[BUFSIZE];
     ssize_t nbytes;
-    std::string leftover;
+    std::string input; // Bytes received but not yet handled: a partial line
+    std::string out;   // Replies to one read; keeps its capacity across reads
+    ClientSession session;
+    session.graph = get_graph(DEFAULT_GRAPH);
+
+    metrics_add(CTR_CONNECTIONS_ACCEPTED);
 
     std::string welcome = "Welcome to the Convex Hull Server!\n";
     send(client_fd, welcome.c_str(), welcome.size(), 0);
+    metrics_add(CTR_BYTES_OUT, welcome.size());
+
+    while ((nbytes = recv(client_fd, buf, sizeof(buf), 0)) > 0) {
+        metrics_add(CTR_BYTES_IN, nbytes);
+        input.append(buf, nbytes);
+        std::string_view pending(input);
+        std::string_view line;
+        out.clear();
 
-    while ((nbytes = recv(client_fd, buf, sizeof(buf) - 1, 0)) > 0) {
-        buf[nbytes] = '\0';
-        std::string input = leftover + std::string(buf);
-        size_t pos = 0;
-        std::string line;
-        std::ostringstream response;
-
-        while ((pos = input.find('\n')) != std::string::npos) {
-            line = input.substr(0, pos);
-            input.erase(0, pos + 1);
-            if (!line.empty() && line.back() == '\r') line.pop_back();
-            if (!line.empty()) {
-                bool handled = false;
-                {
-                    std::lock_guard<std::mutex> lock(points_mutex);
-                    if (points_to_read[client_fd] > 0) {
-                        // Parse as point
-                        std::replace(line.begin(), line.end(), ',', ' ');
-                        std::istringstream iss(line);
-                        float x, y;
-                        if (!(iss >> x >> y)) {
-                            response << "Invalid point format. Example: 1,2\n";
-                        } else {
-                            points.push_back({x, y});
-                            points_to_read[client_fd]--;
-                            if (points_to_read[client_fd] == 0) {
-                                response << "Graph updated with " << points.size() << " points.\n";
-                            } else {
-                                response << "Point added. " << points_to_read[client_fd] << " more to go.\n";
-                            }
-                        }
-                        handled = true;
-                    }
+        while (next_line(pending, line)) {
+            if (line.empty()) continue;
+            if (session.points_to_read > 0) {
+                // Parse as point
+                MetricsTimer timer(HIST_CMD_POINT);
+                Point p;
+                if (!parse_point(line, p)) {
+                    out += "Invalid point format. Example: 1,2\n";
+                    continue;
                 }
-                if (!handled) {
-                    std::istringstream iss(line);
-                    std::string cmd;
-                    iss >> cmd;
-                    if (cmd == "Newgraph") {
-                        int n;
-                        iss >> n;
-                        {
-                            std::lock_guard<std::mutex> lock(points_mutex);
-                            points_to_read[client_fd] = n;
-                        }
-                    }
-                    response << handle_command(line);
+                // Staged and committed together; replies go out only after
+                // the commit, so no client sees an ack before its point
+                session.staged.push_back(p);
+                session.points_to_read--;
+                if (session.points_to_read == 0) {
+                    out += "Graph updated with ";
+                    append_int(out, commit_staged(session));
+                    out += " points.\n";
+                } else {
+                    out += "Point added. ";
+                    append_int(out, session.points_to_read);
+                    out += " more to go.\n";
                 }
+            } else {
+                if (!session.staged.empty()) commit_staged(session);
+                handle_command(session, line, out);
             }
         }
-        leftover = input; 
+        input.erase(0, input.size() - pending.size());
+        if (!session.staged.empty()) commit_staged(session);
 
-        std::string resp = response.str();
-        if (!resp.empty()) {
-            send(client_fd, resp.c_str(), resp.size(), 0);
+        if (!out.empty()) {
+            send(client_fd, out.data(), out.size(), 0);
+            metrics_add(CTR_BYTES_OUT, out.size());
         }
     }
-    {
-        std::lock_guard<std::mutex> lock(points_mutex);
-        points_to_read.erase(client_fd);
-    }
     close(client_fd);
+    metrics_add(CTR_CONNECTIONS_CLOSED);
     std::cout << "Client thread exiting (fd=" << client_fd << ")\n";
+    client_threads--;
 }
 
-void run_server(int port) {
-    int listener;
-    struct sockaddr_in serveraddr, clientaddr;
-    socklen_t addrlen;
-
-    listener = socket(AF_INET, SOCK_STREAM, 0);
-    if (listener < 0) {
-        perror("socket");
-        return;
+static void accept_loop(int listener, const ServerOptions& options) {
+    while (true) {
+        int client_fd = accept_client(listener, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno != EMFILE && errno != ENFILE) perror("accept");
+            continue;
+        }
+        if (options.max_connections > 0 && client_threads.load() >= options.max_connections) {
+            reject_client(client_fd);
+            continue;
+        }
+        std::cout << "New client: fd=" << client_fd << std::endl;
+        client_threads++;
+        try {
+            std::thread(client_thread, client_fd).detach();
+        } catch (const std::system_error& ex) {
+            std::cerr << "thread: " << ex.what() << std::endl;
+            client_threads--;
+            close(client_fd);
+        }
     }
+}
 
-    int yes = 1;
-    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
-
-    memset(&serveraddr, 0, sizeof(serveraddr));
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_addr.s_addr = INADDR_ANY;
-    serveraddr.sin_port = htons(port);
+void run_server(const ServerOptions& options) {
+    int listener = -1, unix_listener = -1;
 
-    if (bind(listener, (struct sockaddr*)&serveraddr, sizeof(serveraddr)) < 0) {
-        perror("bind");
-        close(listener);
+    if (options.port <= 0 && options.unix_path.empty()) {
+        std::cerr << "Nothing to listen on: give a TCP port or a Unix socket path" << std::endl;
         return;
     }
+    if (options.graph_actor) {
+        start_graph_actor();
+        actor_mode = true;
+    }
+    admission_configure(options.max_inflight, options.queue_target_ms);
 
-    if (listen(listener, BACKLOG) < 0) {
-        perror("listen");
-        close(listener);
+    if (options.port > 0 && (listener = open_tcp_listener(options.port, options.backlog, SOCK_CLOEXEC)) < 0) return;
+    if (!options.unix_path.empty() &&
+        (unix_listener = open_unix_listener(options.unix_path, options.backlog, SOCK_CLOEXEC)) < 0) {
+        if (listener >= 0) close(listener);
         return;
     }
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
 
-    std::cout << "Server started on port " << port << std::endl;
+    const char* mode = actor_mode ? " (single-writer graph actor)" : "";
+    if (listener >= 0) std::cout << "Server started on port " << options.port << mode << std::endl;
+    if (unix_listener >= 0) std::cout << "Server started on Unix socket " << options.unix_path << mode << std::endl;
 
-    while (true) {
-        addrlen = sizeof(clientaddr);
-        int client_fd = accept(listener, (struct sockaddr*)&clientaddr, &addrlen);
-        if (client_fd < 0) {
-            if (errno == EINTR) continue;
-            perror("accept");
-            continue;
-        }
-        std::cout << "New client: fd=" << client_fd << std::endl;
-        std::thread(client_thread, client_fd).detach();
+    // Each listener has an accept thread; the TCP one is this thread
+    if (listener >= 0 && unix_listener >= 0) {
+        std::thread(accept_loop, unix_listener, std::cref(options)).detach();
     }
-    close(listener);
-}
\ No newline at end of file
+    accept_loop(listener >= 0 ? listener : unix_listener, options);
+}
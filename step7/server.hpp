@@ -1,8 +1,36 @@
 #pragma once
+#include "admission.hpp"
+#include "graph_store.hpp"
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+
+// Default listen() backlog; the kernel clamps it to net.core.somaxconn
+#define DEFAULT_BACKLOG 1024
+#define DEFAULT_MAX_CONNECTIONS 4096 // More are answered BUSY and closed
+#define DEFAULT_MAX_INFLIGHT 64 // Commands running at once; more wait for a slot
+
+struct ServerOptions {
+    int port = 9034;          // 0: no TCP listener
+    std::string unix_path;    // Also accept clients on this Unix socket ('@' first: abstract namespace)
+    int backlog = DEFAULT_BACKLOG;
+    bool graph_actor = false; // Apply all mutations on one owner thread
+    int max_connections = DEFAULT_MAX_CONNECTIONS; // 0: no cap
+    int max_inflight = DEFAULT_MAX_INFLIGHT; // 0: no admission control
+    int queue_target_ms = DEFAULT_QUEUE_TARGET_MS; // Queueing delay that counts as overload
+};
 
 // Start the convex hull server (blocking call)
-void run_server(int port = 9034);
+void run_server(const ServerOptions& options);
+
+// Per-connection state: the graph the client works on and how many
+// point lines are still expected after Newgraph
+struct ClientSession {
+    std::shared_ptr<Graph> graph;
+    int points_to_read = 0;
+    std::vector<Point> staged; // Point lines received but not yet committed
+};
 
-// Handle a single command from a client and return the response
-std::string handle_command(const std::string& cmdline);
\ No newline at end of file
+// Handle a single command from a client, appending the response to out
+void handle_command(ClientSession& session, std::string_view cmdline, std::string& out);
\ No newline at end of file
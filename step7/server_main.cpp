@@ -1,6 +1,26 @@
 #include "server.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
 
-int main() {
-    run_server(9034);
+int main(int argc, char* argv[]) {
+    ServerOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:u:ac:i:t:")) != -1) {
+        switch (opt) {
+        case 'p': options.port = std::atoi(optarg); break;
+        case 'b': options.backlog = std::atoi(optarg); break;
+        case 'u': options.unix_path = optarg; break;
+        case 'a': options.graph_actor = true; break;
+        case 'c': options.max_connections = std::atoi(optarg); break;
+        case 'i': options.max_inflight = std::atoi(optarg); break;
+        case 't': options.queue_target_ms = std::atoi(optarg); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-p port] [-u unix_path|@name] [-b backlog] [-a] [-c max_connections]"
+                      << " [-i max_inflight] [-t queue_target_ms]" << std::endl;
+            return 1;
+        }
+    }
+    run_server(options);
     return 0;
 }
\ No newline at end of file
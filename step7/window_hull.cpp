@@ -0,0 +1,109 @@
+#include "window_hull.hpp"
+#include <iterator>
+
+static double cross(const Point& O, const Point& A, const Point& B) {
+    return (static_cast<double>(A.x) - O.x) * (static_cast<double>(B.y) - O.y) -
+           (static_cast<double>(A.y) - O.y) * (static_cast<double>(B.x) - O.x);
+}
+
+static Point negate(const Point& p) {
+    return {-p.x, -p.y};
+}
+
+bool HullChain::insert(const Point& p, std::vector<Point>* removed) {
+    std::set<Point>::iterator next = vertices.lower_bound(p);
+    if (next != vertices.end() && !(p < *next)) return false; // Already a vertex
+    // On or above the segment between its neighbours: hidden for as long as
+    // they stay, and they outlive p or are undone after it
+    if (next != vertices.end() && next != vertices.begin() && cross(*std::prev(next), *next, p) >= 0) return false;
+
+    std::set<Point>::iterator it = vertices.insert(next, p);
+    while (true) {
+        std::set<Point>::iterator a = std::next(it);
+        if (a == vertices.end() || std::next(a) == vertices.end() || cross(p, *a, *std::next(a)) > 0) break;
+        if (removed) removed->push_back(*a);
+        vertices.erase(a);
+    }
+    while (it != vertices.begin()) {
+        std::set<Point>::iterator a = std::prev(it);
+        if (a == vertices.begin() || cross(*std::prev(a), *a, p) > 0) break;
+        if (removed) removed->push_back(*a);
+        vertices.erase(a);
+    }
+    return true;
+}
+
+void HullChain::undo(const Point& p, bool inserted, const Point* removed, size_t n) {
+    if (inserted) vertices.erase(p);
+    vertices.insert(removed, removed + n);
+}
+
+bool WindowHull::push(const Point& p) {
+    back.push_back(p);
+    bool lower = back_lower.insert(p, nullptr);
+    bool upper = back_upper.insert(negate(p), nullptr);
+    return lower || upper;
+}
+
+// Replays the back stack into the front chains, newest first, so the oldest
+// point's insertion is the one on top of the undo log
+void WindowHull::refill_front() {
+    for (size_t i = back.size(); i-- > 0;) {
+        FrontEntry entry;
+        entry.p = back[i];
+        size_t before = front_removed.size();
+        entry.in_lower = front_lower.insert(back[i], &front_removed);
+        entry.lower_removed = static_cast<uint32_t>(front_removed.size() - before);
+        before = front_removed.size();
+        entry.in_upper = front_upper.insert(negate(back[i]), &front_removed);
+        entry.upper_removed = static_cast<uint32_t>(front_removed.size() - before);
+        front.push_back(entry);
+    }
+    back.clear();
+    back_lower.clear();
+    back_upper.clear();
+}
+
+bool WindowHull::pop() {
+    if (empty()) return false;
+    bool refilled = front.empty();
+    if (refilled) refill_front();
+    const FrontEntry& entry = front.back();
+    // Undo in reverse: the upper chain's changes were logged last
+    size_t end = front_removed.size();
+    front_upper.undo(negate(entry.p), entry.in_upper, front_removed.data() + end - entry.upper_removed,
+                     entry.upper_removed);
+    end -= entry.upper_removed;
+    front_lower.undo(entry.p, entry.in_lower, front_removed.data() + end - entry.lower_removed,
+                     entry.lower_removed);
+    end -= entry.lower_removed;
+    front_removed.resize(end);
+    bool changed = refilled || entry.in_lower || entry.in_upper;
+    front.pop_back();
+    return changed;
+}
+
+void WindowHull::clear() {
+    front.clear();
+    front_removed.clear();
+    front_lower.clear();
+    front_upper.clear();
+    back.clear();
+    back_lower.clear();
+    back_upper.clear();
+}
+
+std::vector<Point> WindowHull::hull_candidates() const {
+    std::vector<Point> candidates(front_lower.points().begin(), front_lower.points().end());
+    candidates.insert(candidates.end(), back_lower.points().begin(), back_lower.points().end());
+    for (const Point& p : front_upper.points()) candidates.push_back(negate(p));
+    for (const Point& p : back_upper.points()) candidates.push_back(negate(p));
+    return candidates;
+}
+
+void WindowHull::points(std::vector<Point>& out) const {
+    out.clear();
+    out.reserve(size());
+    for (size_t i = front.size(); i-- > 0;) out.push_back(front[i].p);
+    out.insert(out.end(), back.begin(), back.end());
+}
@@ -0,0 +1,110 @@
+#include "admission.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+typedef std::chrono::steady_clock Clock;
+
+static int limit = 0; // Set before any client thread starts
+static Clock::duration target = std::chrono::milliseconds(DEFAULT_QUEUE_TARGET_MS);
+static const Clock::duration interval = std::chrono::milliseconds(ADMISSION_INTERVAL_MS);
+
+// A slot is taken with a CAS, so an idle server never touches the mutex.
+// Commands that find none queue FIFO, and a freed slot goes to the oldest.
+static std::atomic<int> running(0);
+static std::atomic<int> waiting(0);
+static std::atomic<bool> drained(false); // The queue was empty at some point this interval
+
+struct Waiter {
+    std::condition_variable cond;
+    bool granted = false;
+};
+
+static std::mutex mutex; // Guards the rest
+static std::deque<Waiter*> queue;
+static Clock::time_point interval_end;
+static bool overloaded = false;
+
+void admission_configure(int max_inflight, int target_ms) {
+    limit = max_inflight;
+    target = std::chrono::milliseconds(target_ms);
+}
+
+static bool try_take() {
+    int n = running.load();
+    while (n < limit) {
+        if (running.compare_exchange_weak(n, n + 1)) return true;
+    }
+    return false;
+}
+
+static void note_drained() {
+    if (!drained.load(std::memory_order_relaxed)) drained.store(true, std::memory_order_relaxed);
+}
+
+// Caller holds mutex. Only commands that find every slot busy get here, so
+// an interval nobody looked at passed without a queue.
+static void update_state(Clock::time_point now) {
+    if (now < interval_end) return;
+    bool was = overloaded;
+    overloaded = now < interval_end + interval && !drained.exchange(false);
+    if (overloaded && !was) metrics_add(CTR_ADMISSION_OVERLOADS);
+    interval_end = now + interval;
+}
+
+// Caller holds mutex
+static void grant_waiters() {
+    while (!queue.empty() && try_take()) {
+        Waiter* next = queue.front();
+        queue.pop_front();
+        next->granted = true;
+        next->cond.notify_one();
+    }
+    if (queue.empty()) note_drained();
+}
+
+bool admission_enter() {
+    if (limit <= 0) return true;
+    // No barging past waiters, or the queue would never drain
+    if (waiting.load() == 0 && try_take()) {
+        note_drained();
+        metrics_observe(HIST_ADMISSION_WAIT, 0);
+        return true;
+    }
+
+    Clock::time_point arrival = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    update_state(arrival);
+    Clock::time_point deadline = arrival + (overloaded ? target : interval);
+    Waiter self;
+    waiting.fetch_add(1); // Before taking a slot ourselves, so admission_leave can't miss us
+    queue.push_back(&self);
+    grant_waiters();
+    while (!self.granted) {
+        if (self.cond.wait_until(lock, deadline) == std::cv_status::timeout && !self.granted) {
+            queue.erase(std::find(queue.begin(), queue.end(), &self));
+            if (queue.empty()) note_drained();
+            break;
+        }
+    }
+    waiting.fetch_sub(1);
+    Clock::duration waited = Clock::now() - arrival;
+    metrics_observe(HIST_ADMISSION_WAIT, std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count());
+    if (!self.granted) {
+        metrics_add(CTR_COMMANDS_SHED);
+        return false;
+    }
+    return true;
+}
+
+void admission_leave() {
+    running.fetch_sub(1);
+    if (waiting.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        grant_waiters();
+    }
+}
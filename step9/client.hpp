@@ -4,5 +4,9 @@
 // Connects to the server at the given host and port, returns socket fd or -1 on error
 int connect_to_server(const std::string& host, const std::string& port);
 
+// Connects to the server's Unix socket, '@' first for the abstract namespace;
+// returns socket fd or -1 on error
+int connect_to_unix(const std::string& path);
+
 // Runs the interactive client loop (send commands, print responses)
 void run_client(int sockfd);
\ No newline at end of file
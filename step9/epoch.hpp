@@ -0,0 +1,26 @@
+#pragma once
+
+// Epoch-based reclamation for objects that readers access without locks.
+//
+// Readers wrap every access in an EpochGuard. Writers unlink an object
+// (e.g. swap an atomic pointer) and hand it to epoch_retire(); it is deleted
+// only once every thread that might still see it has left its guard.
+
+class EpochGuard {
+public:
+    EpochGuard();
+    ~EpochGuard();
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+typedef void (*EpochDeleter)(void* ptr);
+
+// Defers deleter(ptr) until no reader can hold ptr any more
+void epoch_retire(void* ptr, EpochDeleter deleter);
+
+template <typename T>
+void epoch_retire(T* ptr) {
+    epoch_retire(const_cast<void*>(static_cast<const void*>(ptr)),
+                 [](void* p) { delete static_cast<T*>(p); });
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "graph_store.hpp"
+
+// Optional single-writer mode: one owner thread applies every graph
+// mutation. Client threads push parsed commands onto a lock-free MPSC queue
+// and block until the owner has published the result. The owner drains the
+// queue in batches, so each touched graph is locked and published once per
+// batch instead of once per command.
+
+// Starts the owner thread; call once before submitting anything.
+void start_graph_actor();
+
+// Route a mutation through the owner thread and wait until it is visible.
+void actor_reset(Graph& graph);
+size_t actor_add_point(Graph& graph, const Point& p); // Returns the new point count
+bool actor_remove_point(Graph& graph, const Point& p);
+size_t actor_add_points(Graph& graph, const Point* points, size_t n);
+size_t actor_remove_points(Graph& graph, const Point* points, size_t n);
+size_t actor_set_window(Graph& graph, size_t max_points, double max_seconds);
@@ -0,0 +1,57 @@
+#pragma once
+#include "convex_hull.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Queries against a maintained hull instead of the point set. All of them
+// expect what convex_hull() returns: at least 3 vertices, counter-clockwise,
+// no three collinear.
+
+// The hull as a fan of triangles around hull[0], laid out for hull_classify.
+// A point's pseudo-angle about the fan's axis picks its triangle: a bucket table
+// over the slope range gives a first guess that is rarely more than one
+// triangle short, so there is almost never a search.
+struct HullFan {
+    Point origin;
+    float axis_x = 1.0f, axis_y = 0.0f; // Unit bisector of the fan
+    Point first_ray, last_ray; // hull[1] and hull[n-1] relative to origin; bound the fan
+    std::vector<float> key; // Pseudo-angle of the ray to each vertex, increasing from index 1
+    std::vector<float> edge_x, edge_y, edge_dx, edge_dy; // Triangle w's outer edge, hull[w] -> hull[w+1]
+    std::vector<uint32_t> bucket_triangle; // Triangle holding each bucket's lowest slope
+    float bucket_base = 0.0f, bucket_scale = 0.0f;
+};
+
+// Measures that need a full walk of the hull, found together by rotating
+// calipers in O(h), plus the fan. A snapshot computes them once per hull
+// version.
+struct HullGeometry {
+    float perimeter = 0.0f;
+    float diameter = 0.0f;
+    Point diameter_ends[2];
+    float min_rect_area = 0.0f;
+    Point min_rect[4]; // Counter-clockwise corners of the minimum-area bounding rectangle
+    std::vector<double> normal_angle; // Outward normal of each edge, increasing; for hull_extreme
+    HullFan fan;
+};
+
+void hull_geometry(const std::vector<Point>& hull, HullGeometry& geo);
+
+enum HullSide { HULL_INSIDE, HULL_BOUNDARY, HULL_OUTSIDE };
+
+// Binary search over the fan of triangles at hull[0]; O(log h)
+HullSide hull_locate(const std::vector<Point>& hull, const Point& p);
+
+// Index of the vertex farthest in direction (dx, dy), which must not be
+// (0, 0); O(log h) over geo.normal_angle
+size_t hull_extreme(const std::vector<Point>& hull, const HullGeometry& geo, float dx, float dy);
+
+// The two vertices where lines from p touch the hull; O(log h). False when
+// p is not strictly outside.
+bool hull_tangents(const std::vector<Point>& hull, const HullGeometry& geo, const Point& p,
+                   size_t& first, size_t& second);
+
+// inside[i] = 1 when points[i] is inside or on the hull, else 0. Four
+// points per SSE2 instruction where available. In float, so points within
+// rounding of the boundary may land on either side.
+void hull_classify(const HullFan& fan, const Point* points, size_t n, uint8_t* inside);
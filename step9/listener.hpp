@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+
+// Listening sockets for the server. A Unix socket path starting with '@'
+// names a socket in Linux's abstract namespace: no file is created and the
+// name disappears with the server. Any other path is a socket file; one
+// left behind by a server that is no longer running is replaced.
+
+// TCP on every interface. Returns the fd, or -1 after printing why
+int open_tcp_listener(int port, int backlog, int flags);
+
+// AF_UNIX stream socket at path. Returns the fd, or -1 after printing why
+int open_unix_listener(const std::string& path, int backlog, int flags);